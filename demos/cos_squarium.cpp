@@ -66,7 +66,7 @@ int main(int argc, char** argv)
 
     // Initialise cell list.
     cells.setDimension(dimension);
-    cells.initialise(box.boxSize, interactionRange);
+    cells.initialise(box.boxSize, interactionRange, nParticles);
 
     // Initialise the cosine squared potential model.
     CosSquared cosSquared(box, particles, cells,
@@ -81,6 +81,10 @@ int main(int argc, char** argv)
     // Generate a random particle configuration.
     initialise.random(particles, cells, box, rng, false, nParticlesACTIVE);
 
+    // Inactive (type 0) particles don't interact, active (type 1) particles
+    // interact out to the full range.
+    cosSquared.setInteractionRanges(2, {0, 0, 0, interactionRange});
+
     // Initialise data structures needed by the VMMC class.
     double coordinates[dimension*nParticles];
     int types[nParticles];
@@ -113,22 +117,36 @@ int main(int argc, char** argv)
 #ifndef ISOTROPIC
     callbacks.energyCallback =
         std::bind(&CosSquared::computeEnergy, cosSquared, _1, _2, _3, _4);
+    callbacks.externalEnergyCallback =
+        std::bind(&CosSquared::computeExternalEnergy, cosSquared, _1, _2, _3, _4, _5);
     callbacks.pairEnergyCallback =
         std::bind(&CosSquared::computePairEnergy, cosSquared, _1, _2, _3, _4, _5, _6, _7, _8);
+    callbacks.pairEnergy3Callback =
+        std::bind(&CosSquared::computePairEnergy3, cosSquared, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10);
     callbacks.interactionsCallback =
         std::bind(&CosSquared::computeInteractions, cosSquared, _1, _2, _3, _4);
+    callbacks.interactionEnergiesCallback =
+        std::bind(&CosSquared::computeInteractionEnergies, cosSquared, _1, _2, _3, _4, _5, _6, _7);
     callbacks.postMoveCallback =
         std::bind(&CosSquared::applyPostMoveUpdates, cosSquared, _1, _2, _3);
 #else
     callbacks.energyCallback =
         std::bind(&CosSquared::computeEnergy, cosSquared, _1, _2, _3);
+    callbacks.externalEnergyCallback =
+        std::bind(&CosSquared::computeExternalEnergy, cosSquared, _1, _2, _3, _4);
     callbacks.pairEnergyCallback =
         std::bind(&CosSquared::computePairEnergy, cosSquared, _1, _2, _3, _4, _5, _6);
+    callbacks.pairEnergy3Callback =
+        std::bind(&CosSquared::computePairEnergy3, cosSquared, _1, _2, _3, _4, _5, _6, _7, _8);
     callbacks.interactionsCallback =
         std::bind(&CosSquared::computeInteractions, cosSquared, _1, _2, _3);
+    callbacks.interactionEnergiesCallback =
+        std::bind(&CosSquared::computeInteractionEnergies, cosSquared, _1, _2, _3, _4, _5, _6);
     callbacks.postMoveCallback =
         std::bind(&CosSquared::applyPostMoveUpdates, cosSquared, _1, _2);
 #endif
+    callbacks.reorderCallback =
+        std::bind(&CosSquared::reorder, cosSquared, _1);
 
     // Initialise VMMC object.
 #ifndef ISOTROPIC
@@ -146,6 +164,9 @@ int main(int argc, char** argv)
         // Increment simulation by 1000 Monte Carlo Sweeps.
         //vmmc.step();
         vmmc += 100*nParticles;
+
+        // Reorder particles along a space-filling curve (improves memory locality).
+        vmmc.reorder();
         //if (i%10==0 && i!=0){nParticles =nParticles-1;}
         // Try and re-initialise everything without zero-ing the particle properties
         /*CosSquared cosSquared(box, particles, cells,
@@ -238,7 +259,7 @@ int main(int argc, char** argv)
         else io.appendXyzTrajectory(dimension, particles, false);
 
         // Report.
-        printf("sweeps = %9.4e, energy = %5.4f\n", ((double) (i+1)*1000), cosSquared.getEnergy());
+        printf("sweeps = %9.4e, energy = %5.4f\n", ((double) (i+1)*1000), vmmc.getEnergy()/nParticles);
     }
 
     std::cout << "\nComplete!\n";
@@ -69,7 +69,7 @@ int main(int argc, char** argv)
 
     // Initialise cell list.
     cells.setDimension(dimension);
-    cells.initialise(box.boxSize, interactionRange);
+    cells.initialise(box.boxSize, interactionRange, nParticles);
 
     // Initialise the Lennard-Jones potential model.
     LennardJonesium lennardJonesium(box, particles, cells,
@@ -115,22 +115,36 @@ int main(int argc, char** argv)
 #ifndef ISOTROPIC
     callbacks.energyCallback =
         std::bind(&LennardJonesium::computeEnergy, lennardJonesium, _1, _2, _3, _4);
+    callbacks.externalEnergyCallback =
+        std::bind(&LennardJonesium::computeExternalEnergy, lennardJonesium, _1, _2, _3, _4, _5);
     callbacks.pairEnergyCallback =
         std::bind(&LennardJonesium::computePairEnergy, lennardJonesium, _1, _2, _3, _4, _5, _6, _7, _8);
+    callbacks.pairEnergy3Callback =
+        std::bind(&LennardJonesium::computePairEnergy3, lennardJonesium, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10);
     callbacks.interactionsCallback =
         std::bind(&LennardJonesium::computeInteractions, lennardJonesium, _1, _2, _3, _4);
+    callbacks.interactionEnergiesCallback =
+        std::bind(&LennardJonesium::computeInteractionEnergies, lennardJonesium, _1, _2, _3, _4, _5, _6, _7);
     callbacks.postMoveCallback =
         std::bind(&LennardJonesium::applyPostMoveUpdates, lennardJonesium, _1, _2, _3);
 #else
     callbacks.energyCallback =
         std::bind(&LennardJonesium::computeEnergy, lennardJonesium, _1, _2, _3);
+    callbacks.externalEnergyCallback =
+        std::bind(&LennardJonesium::computeExternalEnergy, lennardJonesium, _1, _2, _3, _4);
     callbacks.pairEnergyCallback =
         std::bind(&LennardJonesium::computePairEnergy, lennardJonesium, _1, _2, _3, _4, _5, _6);
+    callbacks.pairEnergy3Callback =
+        std::bind(&LennardJonesium::computePairEnergy3, lennardJonesium, _1, _2, _3, _4, _5, _6, _7, _8);
     callbacks.interactionsCallback =
         std::bind(&LennardJonesium::computeInteractions, lennardJonesium, _1, _2, _3);
+    callbacks.interactionEnergiesCallback =
+        std::bind(&LennardJonesium::computeInteractionEnergies, lennardJonesium, _1, _2, _3, _4, _5, _6);
     callbacks.postMoveCallback =
         std::bind(&LennardJonesium::applyPostMoveUpdates, lennardJonesium, _1, _2);
 #endif
+    callbacks.reorderCallback =
+        std::bind(&LennardJonesium::reorder, lennardJonesium, _1);
 
     // Initialise the VMMC object.
 #ifndef ISOTROPIC
@@ -147,12 +161,15 @@ int main(int argc, char** argv)
         // Increment simulation by 1000 Monte Carlo Sweeps.
         vmmc += 1000*nParticles;
 
+        // Reorder particles along a space-filling curve (improves memory locality).
+        vmmc.reorder();
+
         // Append particle coordinates to an xyz trajectory.
         if (i == 0) io.appendXyzTrajectory(dimension, particles, true);
         else io.appendXyzTrajectory(dimension, particles, false);
 
         // Report.
-        printf("sweeps = %9.4e, energy = %5.4f\n", ((double) (i+1)*1000), lennardJonesium.getEnergy());
+        printf("sweeps = %9.4e, energy = %5.4f\n", ((double) (i+1)*1000), vmmc.getEnergy()/nParticles);
     }
 
     std::cout << "\nComplete!\n";
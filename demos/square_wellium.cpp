@@ -39,6 +39,9 @@ int main(int argc, char** argv)
     double density = 0.05;                          // particle density
     double baseLength;                              // base length of simulation box
     unsigned int maxInteractions = 15;              // maximum number of interactions per particle
+    bool isIsobaric = false;                        // whether to attempt volume moves
+    double pressure = 0.01;                         // pressure (in units of kBT per unit volume)
+    double maxVolumeChange = 50;                    // maximum trial volume change
 
     // Data structures.
     std::vector<Particle> particles(nParticles);    // particle container
@@ -66,7 +69,7 @@ int main(int argc, char** argv)
 
     // Initialise cell list.
     cells.setDimension(dimension);
-    cells.initialise(box.boxSize, interactionRange);
+    cells.initialise(box.boxSize, interactionRange, nParticles);
 
     // Initialise the square well potential model.
     SquareWellium squareWellium(box, particles, cells,
@@ -112,22 +115,34 @@ int main(int argc, char** argv)
 #ifndef ISOTROPIC
     callbacks.energyCallback =
         std::bind(&SquareWellium::computeEnergy, squareWellium, _1, _2, _3, _4);
+    callbacks.externalEnergyCallback =
+        std::bind(&SquareWellium::computeExternalEnergy, squareWellium, _1, _2, _3, _4, _5);
     callbacks.pairEnergyCallback =
         std::bind(&SquareWellium::computePairEnergy, squareWellium, _1, _2, _3, _4, _5, _6, _7, _8);
     callbacks.interactionsCallback =
         std::bind(&SquareWellium::computeInteractions, squareWellium, _1, _2, _3, _4);
+    callbacks.interactionEnergiesCallback =
+        std::bind(&SquareWellium::computeInteractionEnergies, squareWellium, _1, _2, _3, _4, _5, _6, _7);
     callbacks.postMoveCallback =
         std::bind(&SquareWellium::applyPostMoveUpdates, squareWellium, _1, _2, _3);
 #else
     callbacks.energyCallback =
         std::bind(&SquareWellium::computeEnergy, squareWellium, _1, _2, _3);
+    callbacks.externalEnergyCallback =
+        std::bind(&SquareWellium::computeExternalEnergy, squareWellium, _1, _2, _3, _4);
     callbacks.pairEnergyCallback =
         std::bind(&SquareWellium::computePairEnergy, squareWellium, _1, _2, _3, _4, _5, _6);
     callbacks.interactionsCallback =
         std::bind(&SquareWellium::computeInteractions, squareWellium, _1, _2, _3);
+    callbacks.interactionEnergiesCallback =
+        std::bind(&SquareWellium::computeInteractionEnergies, squareWellium, _1, _2, _3, _4, _5, _6);
     callbacks.postMoveCallback =
         std::bind(&SquareWellium::applyPostMoveUpdates, squareWellium, _1, _2);
 #endif
+    callbacks.reorderCallback =
+        std::bind(&SquareWellium::reorder, squareWellium, _1);
+    callbacks.volumeChangeCallback =
+        std::bind(&SquareWellium::applyVolumeChange, squareWellium, _1, _2);
 
     // Initialise VMMC object.
 #ifndef ISOTROPIC
@@ -142,14 +157,26 @@ int main(int argc, char** argv)
     for (unsigned int i=0;i<1000;i++)
     {
         // Increment simulation by 1000 Monte Carlo Sweeps.
-        vmmc += 1000*nParticles;
+        if (isIsobaric)
+        {
+            // Attempt a volume move after every sweep.
+            for (unsigned int j=0;j<1000;j++)
+            {
+                vmmc += nParticles;
+                vmmc.volumeMove(pressure, maxVolumeChange);
+            }
+        }
+        else vmmc += 1000*nParticles;
+
+        // Reorder particles along a space-filling curve (improves memory locality).
+        vmmc.reorder();
 
         // Append particle coordinates to an xyz trajectory.
         if (i == 0) io.appendXyzTrajectory(dimension, particles, true);
         else io.appendXyzTrajectory(dimension, particles, false);
 
         // Report.
-        printf("sweeps = %9.4e, energy = %5.4f\n", ((double) (i+1)*1000), squareWellium.getEnergy());
+        printf("sweeps = %9.4e, energy = %5.4f\n", ((double) (i+1)*1000), vmmc.getEnergy()/nParticles);
     }
 
     std::cout << "\nComplete!\n";
@@ -65,7 +65,8 @@ int main(int argc, char** argv)
 
     // Initialise cell list.
     cells.setDimension(dimension);
-    cells.initialise(box.boxSize, interactionRange);
+    cells.setPeriodicity(isPeriodic);
+    cells.initialise(box.boxSize, interactionRange, nParticles);
 
     // Initialise the square well potential model.
     SquareWellium squareWellium(box, particles, cells,
@@ -77,6 +78,9 @@ int main(int argc, char** argv)
     // Initialise particle initialisation object.
     Initialise initialise;
 
+    // Drop cells that lie outside of the spherocylinder.
+    initialise.setSpherocylinderMask(cells, box);
+
     // Generate a random particle configuration.
     initialise.random(particles, cells, box, rng, true,nParticles_a);
 
@@ -111,10 +115,14 @@ int main(int argc, char** argv)
 #ifndef ISOTROPIC
     callbacks.energyCallback =
         std::bind(&SquareWellium::computeEnergy, squareWellium, _1, _2, _3, _4);
+    callbacks.externalEnergyCallback =
+        std::bind(&SquareWellium::computeExternalEnergy, squareWellium, _1, _2, _3, _4, _5);
     callbacks.pairEnergyCallback =
         std::bind(&SquareWellium::computePairEnergy, squareWellium, _1, _2, _3, _4, _5, _6, _7, _8);
     callbacks.interactionsCallback =
         std::bind(&SquareWellium::computeInteractions, squareWellium, _1, _2, _3, _4);
+    callbacks.interactionEnergiesCallback =
+        std::bind(&SquareWellium::computeInteractionEnergies, squareWellium, _1, _2, _3, _4, _5, _6, _7);
     callbacks.postMoveCallback =
         std::bind(&SquareWellium::applyPostMoveUpdates, squareWellium, _1, _2, _3);
     callbacks.boundaryCallback =
@@ -122,37 +130,55 @@ int main(int argc, char** argv)
 #else
     callbacks.energyCallback =
         std::bind(&SquareWellium::computeEnergy, squareWellium, _1, _2, _3);
+    callbacks.externalEnergyCallback =
+        std::bind(&SquareWellium::computeExternalEnergy, squareWellium, _1, _2, _3, _4);
     callbacks.pairEnergyCallback =
         std::bind(&SquareWellium::computePairEnergy, squareWellium, _1, _2, _3, _4, _5, _6);
     callbacks.interactionsCallback =
         std::bind(&SquareWellium::computeInteractions, squareWellium, _1, _2, _3);
+    callbacks.interactionEnergiesCallback =
+        std::bind(&SquareWellium::computeInteractionEnergies, squareWellium, _1, _2, _3, _4, _5, _6);
     callbacks.postMoveCallback =
         std::bind(&SquareWellium::applyPostMoveUpdates, squareWellium, _1, _2);
     callbacks.boundaryCallback =
         std::bind(&Initialise::outsideSpherocylinder, initialise, _1, _2);
 #endif
+    callbacks.reorderCallback =
+        std::bind(&SquareWellium::reorder, squareWellium, _1);
+
+    // Copy box periodicity into a C-style array.
+    bool periodic[dimension];
+    for (unsigned int i=0;i<dimension;i++) periodic[i] = isPeriodic[i];
 
     // Initialise VMMC object.
 #ifndef ISOTROPIC
     vmmc::VMMC vmmc(nParticles, dimension, coordinates,types, orientations,
-        0.15, 0.2, 0.5, 0.5, maxInteractions, &boxSize[0], isIsotropic, false, callbacks);
+        0.15, 0.2, 0.5, 0.5, maxInteractions, &boxSize[0], periodic, isIsotropic, false, callbacks);
 #else
     vmmc::VMMC vmmc(nParticles, dimension, coordinates,types,
-        0.15, 0.2, 0.5, 0.5, maxInteractions, &boxSize[0], false, callbacks);
+        0.15, 0.2, 0.5, 0.5, maxInteractions, &boxSize[0], periodic, false, callbacks);
 #endif
 
+    // Choose the fastest neighbour search by timing short runs.
+    Autotuner autotuner(vmmc, cells, particles, box, interactionRange);
+    autotuner.tune();
+
     // Execute the simulation.
     for (unsigned int i=0;i<1000;i++)
     {
-        // Increment simulation by 1000 Monte Carlo Sweeps.
-        vmmc += 1000*nParticles;
+        // Increment simulation by 1000 Monte Carlo Sweeps (re-tuning the
+        // neighbour search if the simulation slows down).
+        autotuner.run(1000*nParticles);
+
+        // Reorder particles along a space-filling curve (improves memory locality).
+        vmmc.reorder();
 
         // Append particle coordinates to an xyz trajectory.
         if (i == 0) io.appendXyzTrajectory(dimension, particles, true);
         else io.appendXyzTrajectory(dimension, particles, false);
 
         // Report.
-        printf("sweeps = %9.4e, energy = %5.4f\n", ((double) (i+1)*1000), squareWellium.getEnergy());
+        printf("sweeps = %9.4e, energy = %5.4f\n", ((double) (i+1)*1000), vmmc.getEnergy()/nParticles);
     }
 
     std::cout << "\nComplete!\n";
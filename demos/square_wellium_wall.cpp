@@ -75,7 +75,8 @@ int main(int argc, char** argv)
 
     // Initialise cell list.
     cells.setDimension(dimension);
-    cells.initialise(box.boxSize, interactionRange);
+    cells.setPeriodicity(isPeriodic);
+    cells.initialise(box.boxSize, interactionRange, nParticles);
 
     // Initialise the square well potential model.
     SquareWelliumWall squareWelliumWall(box, particles, cells, maxInteractions,
@@ -121,10 +122,14 @@ int main(int argc, char** argv)
 #ifndef ISOTROPIC
     callbacks.energyCallback =
         std::bind(&SquareWelliumWall::computeEnergy, squareWelliumWall, _1, _2, _3, _4);
+    callbacks.externalEnergyCallback =
+        std::bind(&SquareWelliumWall::computeExternalEnergy, squareWelliumWall, _1, _2, _3, _4, _5);
     callbacks.pairEnergyCallback =
         std::bind(&SquareWelliumWall::computePairEnergy, squareWelliumWall, _1, _2, _3, _4, _5, _6, _7, _8);
     callbacks.interactionsCallback =
         std::bind(&SquareWelliumWall::computeInteractions, squareWelliumWall, _1, _2, _3, _4);
+    callbacks.interactionEnergiesCallback =
+        std::bind(&SquareWelliumWall::computeInteractionEnergies, squareWelliumWall, _1, _2, _3, _4, _5, _6, _7);
     callbacks.postMoveCallback =
         std::bind(&SquareWelliumWall::applyPostMoveUpdates, squareWelliumWall, _1, _2, _3);
     callbacks.nonPairwiseCallback =
@@ -134,10 +139,14 @@ int main(int argc, char** argv)
 #else
     callbacks.energyCallback =
         std::bind(&SquareWelliumWall::computeEnergy, squareWelliumWall, _1, _2, _3);
+    callbacks.externalEnergyCallback =
+        std::bind(&SquareWelliumWall::computeExternalEnergy, squareWelliumWall, _1, _2, _3, _4);
     callbacks.pairEnergyCallback =
         std::bind(&SquareWelliumWall::computePairEnergy, squareWelliumWall, _1, _2, _3, _4, _5, _6);
     callbacks.interactionsCallback =
         std::bind(&SquareWelliumWall::computeInteractions, squareWelliumWall, _1, _2, _3);
+    callbacks.interactionEnergiesCallback =
+        std::bind(&SquareWelliumWall::computeInteractionEnergies, squareWelliumWall, _1, _2, _3, _4, _5, _6);
     callbacks.postMoveCallback =
         std::bind(&SquareWelliumWall::applyPostMoveUpdates, squareWelliumWall, _1, _2);
     callbacks.nonPairwiseCallback =
@@ -145,14 +154,20 @@ int main(int argc, char** argv)
     callbacks.boundaryCallback =
         std::bind(&SquareWelliumWall::isOutsideBoundary, squareWelliumWall, _1, _2);
 #endif
+    callbacks.reorderCallback =
+        std::bind(&SquareWelliumWall::reorder, squareWelliumWall, _1);
+
+    // Copy box periodicity into a C-style array.
+    bool periodic[dimension];
+    for (unsigned int i=0;i<dimension;i++) periodic[i] = isPeriodic[i];
 
     // Initialise VMMC object.
 #ifndef ISOTROPIC
     vmmc::VMMC vmmc(nParticles, dimension, coordinates, types, orientations,
-        0.15, 0.2, 0.5, 0.5, maxInteractions, &boxSize[0], isIsotropic, false, callbacks);
+        0.15, 0.2, 0.5, 0.5, maxInteractions, &boxSize[0], periodic, isIsotropic, false, callbacks);
 #else
     vmmc::VMMC vmmc(nParticles, dimension, coordinates, types,
-        0.15, 0.2, 0.5, 0.5, maxInteractions, &boxSize[0], false, callbacks);
+        0.15, 0.2, 0.5, 0.5, maxInteractions, &boxSize[0], periodic, false, callbacks);
 #endif
 
     // Execute the simulation.
@@ -161,12 +176,15 @@ int main(int argc, char** argv)
         // Increment simulation by 1000 Monte Carlo Sweeps.
         vmmc += 1000*nParticles;
 
+        // Reorder particles along a space-filling curve (improves memory locality).
+        vmmc.reorder();
+
         // Append particle coordinates to an xyz trajectory.
         if (i == 0) io.appendXyzTrajectory(dimension, particles, true);
         else io.appendXyzTrajectory(dimension, particles, false);
 
         // Report.
-        printf("sweeps = %9.4e, energy = %5.4f\n", ((double) (i+1)*1000), squareWelliumWall.getEnergy());
+        printf("sweeps = %9.4e, energy = %5.4f\n", ((double) (i+1)*1000), vmmc.getEnergy()/nParticles);
     }
 
     std::cout << "\nComplete!\n";
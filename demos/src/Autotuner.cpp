@@ -0,0 +1,125 @@
+/*
+  Copyright (c) 2015-2016 Lester Hedges <lester.hedges+vmmc@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+
+#include "Autotuner.h"
+#include "Box.h"
+#include "Particle.h"
+#include "VMMC.h"
+
+Autotuner::Autotuner(
+    vmmc::VMMC& vmmc_,
+    CellList& cells_,
+    std::vector<Particle>& particles_,
+    Box& box_,
+    double range_,
+    unsigned int trialSteps_) :
+
+    vmmc(vmmc_),
+    cells(cells_),
+    particles(particles_),
+    box(box_),
+    range(range_),
+    trialSteps(trialSteps_),
+    strategy(CellList::AUTOMATIC),
+    subdivisions(0),
+    throughput(0)
+{
+}
+
+void Autotuner::tune()
+{
+    // Candidate strategies and numbers of subdivisions.
+    std::vector<CellList::Strategy> strategies;
+    std::vector<unsigned int> subdivisions_;
+
+    if (particles.size() <= MAX_BRUTE_FORCE)
+    {
+        strategies.push_back(CellList::BRUTE_FORCE);
+        subdivisions_.push_back(1);
+    }
+
+    for (unsigned int k=1;k<=CellList::MAX_SUBDIVISIONS;k++)
+    {
+        strategies.push_back(CellList::CELLS);
+        subdivisions_.push_back(k);
+    }
+
+    strategies.push_back(CellList::VERLET);
+    subdivisions_.push_back(1);
+
+    throughput = 0;
+
+    for (unsigned int i=0;i<strategies.size();i++)
+    {
+        apply(strategies[i], subdivisions_[i]);
+
+        double rate = measure(trialSteps);
+
+        if (rate > throughput)
+        {
+            throughput = rate;
+            strategy = strategies[i];
+            subdivisions = subdivisions_[i];
+        }
+    }
+
+    // Apply the fastest candidate.
+    apply(strategy, subdivisions);
+}
+
+void Autotuner::run(unsigned int steps)
+{
+    if (throughput == 0) tune();
+
+    // Re-tune if the simulation has slowed down, e.g. following clustering.
+    if (measure(steps) < RETUNE_THRESHOLD*throughput) tune();
+}
+
+CellList::Strategy Autotuner::getStrategy() const
+{
+    return strategy;
+}
+
+unsigned int Autotuner::getSubdivisions() const
+{
+    return subdivisions;
+}
+
+double Autotuner::getThroughput() const
+{
+    return throughput;
+}
+
+void Autotuner::apply(CellList::Strategy strategy_, unsigned int subdivisions_)
+{
+    cells.setStrategy(strategy_);
+    cells.initialise(box.boxSize, range, particles.size(), subdivisions_);
+    cells.initCellList(particles);
+}
+
+double Autotuner::measure(unsigned int steps)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    vmmc += steps;
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return steps / elapsed.count();
+}
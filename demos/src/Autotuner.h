@@ -0,0 +1,129 @@
+/*
+  Copyright (c) 2015-2016 Lester Hedges <lester.hedges+vmmc@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _AUTOTUNER_H
+#define _AUTOTUNER_H
+
+#include <vector>
+
+#include "CellList.h"
+
+/*! \file Autotuner.h
+    \brief A class for tuning the neighbour search by timing short runs.
+*/
+
+// FORWARD DECLARATIONS
+
+class  Box;
+struct Particle;
+
+namespace vmmc
+{
+    class VMMC;
+}
+
+//! Class for choosing the fastest neighbour search strategy and cell size.
+/*! Each candidate (brute force, cell lists with one to three cells per
+    interaction range, and Verlet lists) is applied via CellList::initialise
+    and timed over a short run of VMMC steps on the real configuration. The
+    fastest is kept. The simulation is then advanced with run, which re-tunes
+    whenever the measured throughput falls well below that of the chosen
+    candidate, e.g. as the system clusters.
+
+    N.B. The timed steps are genuine Monte Carlo steps, i.e. tuning advances
+    the simulation.
+ */
+class Autotuner
+{
+public:
+    //! Constructor.
+    /*! \param vmmc_
+            A reference to the VMMC object.
+
+        \param cells_
+            A reference to the cell list object.
+
+        \param particles_
+            A reference to the particle list.
+
+        \param box_
+            A reference to the simulation box object.
+
+        \param range_
+            Maximum interaction range.
+
+        \param trialSteps_
+            The number of VMMC steps used to time each candidate.
+     */
+    Autotuner(vmmc::VMMC&, CellList&, std::vector<Particle>&, Box&, double, unsigned int trialSteps_ = 1000);
+
+    //! Time each candidate and apply the fastest.
+    void tune();
+
+    //! Advance the simulation, re-tuning if the throughput has degraded.
+    /*! \param steps
+            The number of VMMC steps.
+     */
+    void run(unsigned int);
+
+    //! Get the chosen neighbour search strategy.
+    CellList::Strategy getStrategy() const;
+
+    //! Get the chosen number of cells per interaction range.
+    unsigned int getSubdivisions() const;
+
+    //! Get the throughput of the chosen candidate (VMMC steps per second).
+    double getThroughput() const;
+
+private:
+    vmmc::VMMC& vmmc;                   //!< A reference to the VMMC object.
+    CellList& cells;                    //!< A reference to the cell list.
+    std::vector<Particle>& particles;   //!< A reference to the particle list.
+    Box& box;                           //!< A reference to the simulation box.
+    double range;                       //!< Maximum interaction range.
+    unsigned int trialSteps;            //!< Number of VMMC steps used to time each candidate.
+
+    CellList::Strategy strategy;        //!< The chosen neighbour search strategy.
+    unsigned int subdivisions;          //!< The chosen number of cells per interaction range.
+    double throughput;                  //!< Throughput of the chosen candidate (VMMC steps per second).
+
+    //! Rebuild the cell list for a candidate.
+    /*! \param strategy_
+            The neighbour search strategy.
+
+        \param subdivisions_
+            The number of cells per interaction range.
+     */
+    void apply(CellList::Strategy, unsigned int);
+
+    //! Time a run of VMMC steps.
+    /*! \param steps
+            The number of VMMC steps.
+
+        \return
+            The throughput (VMMC steps per second).
+     */
+    double measure(unsigned int);
+
+    /// Fraction of the tuned throughput below which the neighbour search is re-tuned.
+    static constexpr double RETUNE_THRESHOLD = 0.7;
+
+    /// Maximum number of particles for which a brute-force search is a candidate.
+    static const unsigned int MAX_BRUTE_FORCE = 2000;
+};
+
+#endif  /* _AUTOTUNER_H */
@@ -0,0 +1,630 @@
+/*
+  Copyright (c) 2015-2016 Lester Hedges <lester.hedges+vmmc@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _BONDEDMODEL_H
+#define _BONDEDMODEL_H
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <utility>
+
+#include "Bonds.h"
+#include "Box.h"
+#include "Particle.h"
+
+/*! \file BondedModel.h
+*/
+
+//! Model combining a fixed bond topology with the pair energies of a non-bonded model.
+/*! The non-bonded model is passed as the template parameter, e.g.
+    BondedModel<LennardJonesium>, and its constructor arguments follow the
+    bonds. Bond energies are added to every energy callback, and bonded
+    partners are always reported as interactions, so bonds take part in
+    link recruitment and filaments move as a whole. Bonded partners are
+    found from the compressed bond lists in O(degree), never from the cell
+    list. The maximum number of interactions must allow for both the
+    non-bonded neighbours and the bonds of a particle.
+
+    The bonds are shared between copies of the model, since callbacks are
+    typically bound to copies, so that reordering updates every copy.
+ */
+template <class NonBonded>
+class BondedModel : public NonBonded
+{
+public:
+    //! Constructor.
+    /*! \param bonds_
+            The bond topology (compiled for the particle list on construction).
+
+        \param args
+            The constructor arguments of the non-bonded model.
+     */
+    template <typename... Args>
+    BondedModel(const Bonds& bonds_, Args&&... args) :
+        NonBonded(std::forward<Args>(args)...), bonds(std::make_shared<Bonds>(bonds_))
+    {
+        bonds->build(this->particles.size());
+    }
+
+    //! Calculate the total interaction energy felt by a particle.
+    /*! \param index
+            The particle index.
+
+        \param position
+            The position vector of the particle.
+
+        \param type
+            The type of the particle.
+
+        \param orientation
+            The orientation vector of the particle.
+
+        \return
+            The total interaction energy.
+     */
+#ifndef ISOTROPIC
+    double computeEnergy(unsigned int, const double*, unsigned int, const double*);
+#else
+    double computeEnergy(unsigned int, const double*, unsigned int);
+#endif
+
+    //! Calculate the interaction energy felt by a particle due to particles outside the moving cluster.
+    /*! \param index
+            The particle index.
+
+        \param position
+            The position vector of the particle.
+
+        \param type
+            The type of the particle.
+
+        \param orientation
+            The orientation vector of the particle.
+
+        \param isMoving
+            Mask of particle indices, non-zero if the particle is part of the moving cluster.
+
+        \return
+            The interaction energy due to non-moving neighbours.
+     */
+#ifndef ISOTROPIC
+    double computeExternalEnergy(unsigned int, const double*, unsigned int, const double*, const char*);
+#else
+    double computeExternalEnergy(unsigned int, const double*, unsigned int, const char*);
+#endif
+
+    //! Calculate the pair energy between two particles.
+    /*! \param particle1
+            The index of the first particle.
+
+        \param position1
+            The position vector of the first particle.
+
+        \param type1
+            The type of the first particle.
+
+        \param orientation1
+            The orientation vector of the first particle.
+
+        \param particle2
+            The index of the second particle.
+
+        \param position2
+            The position vector of the second particle.
+
+        \param type2
+            The type of the second particle.
+
+        \param orientation2
+            The orientation vector of the second particle.
+
+        \return
+            The pair energy between particles 1 and 2.
+     */
+#ifndef ISOTROPIC
+    double computePairEnergy(unsigned int, const double*, unsigned int, const double*, unsigned int, const double*, unsigned int, const double*);
+#else
+    double computePairEnergy(unsigned int, const double*, unsigned int, unsigned int, const double*, unsigned int);
+#endif
+
+    //! Calculate the pair energy between two particles for several configurations of the first particle.
+    /*! \param particle1
+            The index of the first particle.
+
+        \param positions1
+            Pointers to the position vectors of the first particle.
+
+        \param type1
+            The type of the first particle.
+
+        \param orientations1
+            Pointers to the orientation vectors of the first particle.
+
+        \param nConfigurations
+            The number of configurations of the first particle.
+
+        \param particle2
+            The index of the second particle.
+
+        \param position2
+            The position vector of the second particle.
+
+        \param type2
+            The type of the second particle.
+
+        \param orientation2
+            The orientation vector of the second particle.
+
+        \param energies
+            An array to store the pair energy for each configuration.
+     */
+#ifndef ISOTROPIC
+    void computePairEnergy3(unsigned int, const double* const*, unsigned int, const double* const*, unsigned int,
+        unsigned int, const double*, unsigned int, const double*, double*);
+#else
+    void computePairEnergy3(unsigned int, const double* const*, unsigned int, unsigned int,
+        unsigned int, const double*, unsigned int, double*);
+#endif
+
+    //! Determine the interactions for a given particle, including its bonded partners.
+    /*! \param particle
+            The particle index.
+
+        \param position
+            The position vector of the particle.
+
+        \param orientation
+            The orientation vector of the particle.
+
+        \param interactions
+            An array to store the indices of neighbours with which the particle interacts.
+
+        \return
+            The number of interactions.
+     */
+#ifndef ISOTROPIC
+    unsigned int computeInteractions(unsigned int, const double*, const double*, unsigned int*);
+#else
+    unsigned int computeInteractions(unsigned int, const double*, unsigned int*);
+#endif
+
+    //! Determine the interactions for a given particle, including its bonded partners, along with their pair energies.
+    /*! \param particle
+            The particle index.
+
+        \param position
+            The position vector of the particle.
+
+        \param type
+            The type of the particle.
+
+        \param orientation
+            The orientation vector of the particle.
+
+        \param interactions
+            An array to store the indices of neighbours with which the particle interacts.
+
+        \param energies
+            An array to store the pair energy for each interaction.
+
+        \param squaredDistances
+            An array to store the squared separation for each interaction (may be null).
+
+        \return
+            The number of interactions.
+     */
+#ifndef ISOTROPIC
+    unsigned int computeInteractionEnergies(unsigned int, const double*, unsigned int, const double*, unsigned int*, double*, double*);
+#else
+    unsigned int computeInteractionEnergies(unsigned int, const double*, unsigned int, unsigned int*, double*, double*);
+#endif
+
+    //! Calculate the pair energies between a particle and a list of neighbours.
+    /*! \param particle
+            The index of the particle.
+
+        \param position
+            The position vector of the particle.
+
+        \param type
+            The type of the particle.
+
+        \param orientation
+            The orientation vector of the particle.
+
+        \param nNeighbours
+            The number of neighbours.
+
+        \param neighbours
+            The indices of the neighbours.
+
+        \param energies
+            An array to store the pair energy with each neighbour.
+     */
+#ifndef ISOTROPIC
+    void computePairEnergies(unsigned int, const double*, unsigned int, const double*, unsigned int, const unsigned int*, double*);
+#else
+    void computePairEnergies(unsigned int, const double*, unsigned int, unsigned int, const unsigned int*, double*);
+#endif
+
+    //! Apply a new particle ordering, e.g. following a call to VMMC::reorder.
+    /*! \param order
+            The new particle ordering: order[i] is the previous index of the
+            particle that now has index i.
+     */
+    void reorder(const unsigned int*);
+
+    //! Get the average energy per particle, including the bond energy.
+    /*! \return
+            The average energy.
+     */
+    double getEnergy();
+
+    //! Get the bond topology.
+    /*! \return
+            A reference to the bonds.
+     */
+    const Bonds& getBonds() const { return *bonds; }
+
+private:
+    std::shared_ptr<Bonds> bonds;       //!< The bond topology (shared between copies of the model).
+
+    //! Calculate the bond energy of a particle.
+    /*! \param particle
+            The particle index.
+
+        \param position
+            The position vector of the particle.
+
+        \param isMoving
+            Flags for bonded partners to exclude, e.g. the moving cluster (may be null).
+
+        \return
+            The total energy of the bonds of the particle.
+     */
+    double computeBondedEnergy(unsigned int, const double*, const char*) const;
+
+    //! Append the bonded partners of a particle that aren't already in a list of interactions.
+    /*! \param particle
+            The particle index.
+
+        \param interactions
+            The list of interactions.
+
+        \param nInteractions
+            The number of interactions in the list.
+
+        \return
+            The number of interactions, including bonded partners.
+     */
+    unsigned int appendPartners(unsigned int, unsigned int*, unsigned int) const;
+
+    //! Find a particle in a list of interactions.
+    /*! \param particle
+            The particle index.
+
+        \param interactions
+            The list of interactions.
+
+        \param nInteractions
+            The number of interactions in the list.
+
+        \return
+            The position of the particle in the list (nInteractions if absent).
+     */
+    static unsigned int findInteraction(unsigned int, const unsigned int*, unsigned int);
+};
+
+#ifndef ISOTROPIC
+template <class NonBonded>
+double BondedModel<NonBonded>::computeEnergy(unsigned int particle, const double* position,
+    unsigned int type, const double* orientation)
+{
+    return NonBonded::computeEnergy(particle, position, type, orientation)
+        + computeBondedEnergy(particle, position, nullptr);
+}
+#else
+template <class NonBonded>
+double BondedModel<NonBonded>::computeEnergy(unsigned int particle, const double* position, unsigned int type)
+{
+    return NonBonded::computeEnergy(particle, position, type)
+        + computeBondedEnergy(particle, position, nullptr);
+}
+#endif
+
+#ifndef ISOTROPIC
+template <class NonBonded>
+double BondedModel<NonBonded>::computeExternalEnergy(unsigned int particle, const double* position,
+    unsigned int type, const double* orientation, const char* isMoving)
+{
+    return NonBonded::computeExternalEnergy(particle, position, type, orientation, isMoving)
+        + computeBondedEnergy(particle, position, isMoving);
+}
+#else
+template <class NonBonded>
+double BondedModel<NonBonded>::computeExternalEnergy(unsigned int particle, const double* position,
+    unsigned int type, const char* isMoving)
+{
+    return NonBonded::computeExternalEnergy(particle, position, type, isMoving)
+        + computeBondedEnergy(particle, position, isMoving);
+}
+#endif
+
+#ifndef ISOTROPIC
+template <class NonBonded>
+double BondedModel<NonBonded>::computePairEnergy(unsigned int particle1, const double* position1, unsigned int type1,
+    const double* orientation1, unsigned int particle2, const double* position2, unsigned int type2, const double* orientation2)
+{
+    double energy = NonBonded::computePairEnergy(particle1, position1, type1, orientation1,
+        particle2, position2, type2, orientation2);
+#else
+template <class NonBonded>
+double BondedModel<NonBonded>::computePairEnergy(unsigned int particle1, const double* position1, unsigned int type1,
+    unsigned int particle2, const double* position2, unsigned int type2)
+{
+    double energy = NonBonded::computePairEnergy(particle1, position1, type1, particle2, position2, type2);
+#endif
+
+    // Add the energy of any bonds between the pair (in a single pass over the bonds).
+    const unsigned int* partners;
+    const unsigned int* potentials;
+    unsigned int nBonds = bonds->getBonds(particle1, partners, potentials);
+
+    for (unsigned int i=0;i<nBonds;i++)
+    {
+        if (partners[i] == particle2)
+            energy += bonds->computeBondEnergy(potentials[i], this->box.computeSquaredDistance(position1, position2));
+    }
+
+    return energy;
+}
+
+#ifndef ISOTROPIC
+template <class NonBonded>
+void BondedModel<NonBonded>::computePairEnergy3(unsigned int particle1, const double* const* positions1, unsigned int type1,
+    const double* const* orientations1, unsigned int nConfigurations, unsigned int particle2,
+    const double* position2, unsigned int type2, const double* orientation2, double* energies)
+{
+    NonBonded::computePairEnergy3(particle1, positions1, type1, orientations1, nConfigurations,
+        particle2, position2, type2, orientation2, energies);
+#else
+template <class NonBonded>
+void BondedModel<NonBonded>::computePairEnergy3(unsigned int particle1, const double* const* positions1, unsigned int type1,
+    unsigned int nConfigurations, unsigned int particle2, const double* position2, unsigned int type2, double* energies)
+{
+    NonBonded::computePairEnergy3(particle1, positions1, type1, nConfigurations,
+        particle2, position2, type2, energies);
+#endif
+
+    // Add the energy of any bonds between the pair (in a single pass over the bonds).
+    const unsigned int* partners;
+    const unsigned int* potentials;
+    unsigned int nBonds = bonds->getBonds(particle1, partners, potentials);
+
+    for (unsigned int i=0;i<nBonds;i++)
+    {
+        if (partners[i] == particle2)
+        {
+            for (unsigned int j=0;j<nConfigurations;j++)
+                energies[j] += bonds->computeBondEnergy(potentials[i], this->box.computeSquaredDistance(positions1[j], position2));
+        }
+    }
+}
+
+#ifndef ISOTROPIC
+template <class NonBonded>
+unsigned int BondedModel<NonBonded>::computeInteractions(unsigned int particle,
+    const double* position, const double* orientation, unsigned int* interactions)
+{
+    unsigned int nInteractions = NonBonded::computeInteractions(particle, position, orientation, interactions);
+#else
+template <class NonBonded>
+unsigned int BondedModel<NonBonded>::computeInteractions(unsigned int particle,
+    const double* position, unsigned int* interactions)
+{
+    unsigned int nInteractions = NonBonded::computeInteractions(particle, position, interactions);
+#endif
+
+    return appendPartners(particle, interactions, nInteractions);
+}
+
+#ifndef ISOTROPIC
+template <class NonBonded>
+unsigned int BondedModel<NonBonded>::computeInteractionEnergies(unsigned int particle, const double* position,
+    unsigned int type, const double* orientation, unsigned int* interactions, double* energies, double* squaredDistances)
+{
+    unsigned int nInteractions = NonBonded::computeInteractionEnergies(particle, position, type, orientation,
+        interactions, energies, squaredDistances);
+#else
+template <class NonBonded>
+unsigned int BondedModel<NonBonded>::computeInteractionEnergies(unsigned int particle, const double* position,
+    unsigned int type, unsigned int* interactions, double* energies, double* squaredDistances)
+{
+    unsigned int nInteractions = NonBonded::computeInteractionEnergies(particle, position, type,
+        interactions, energies, squaredDistances);
+#endif
+
+    const unsigned int* partners;
+    const unsigned int* potentials;
+    unsigned int nBonds = bonds->getBonds(particle, partners, potentials);
+
+    for (unsigned int i=0;i<nBonds;i++)
+    {
+        const Particle& partner = this->particles[partners[i]];
+
+        double normSqd = this->box.computeSquaredDistance(position, &partner.position[0]);
+        double energy = bonds->computeBondEnergy(potentials[i], normSqd);
+
+        unsigned int j = findInteraction(partners[i], interactions, nInteractions);
+
+        // Partner is already a neighbour.
+        if (j < nInteractions) energies[j] += energy;
+
+        // Partner is beyond the non-bonded cut-off.
+        else
+        {
+            if (nInteractions == this->maxInteractions)
+            {
+                std::cerr << "[ERROR] BondedModel: Maximum number of interactions exceeded!\n";
+                exit(EXIT_FAILURE);
+            }
+
+            // Include any residual non-bonded pair energy.
+#ifndef ISOTROPIC
+            energy += NonBonded::computePairEnergy(particle, position, type, orientation,
+                partners[i], &partner.position[0], partner.type, &partner.orientation[0]);
+#else
+            energy += NonBonded::computePairEnergy(particle, position, type,
+                partners[i], &partner.position[0], partner.type);
+#endif
+
+            interactions[nInteractions] = partners[i];
+            energies[nInteractions] = energy;
+
+            if (squaredDistances != nullptr) squaredDistances[nInteractions] = normSqd;
+
+            nInteractions++;
+        }
+    }
+
+    return nInteractions;
+}
+
+#ifndef ISOTROPIC
+template <class NonBonded>
+void BondedModel<NonBonded>::computePairEnergies(unsigned int particle, const double* position, unsigned int type,
+    const double* orientation, unsigned int nNeighbours, const unsigned int* neighbours, double* energies)
+{
+    NonBonded::computePairEnergies(particle, position, type, orientation, nNeighbours, neighbours, energies);
+#else
+template <class NonBonded>
+void BondedModel<NonBonded>::computePairEnergies(unsigned int particle, const double* position, unsigned int type,
+    unsigned int nNeighbours, const unsigned int* neighbours, double* energies)
+{
+    NonBonded::computePairEnergies(particle, position, type, nNeighbours, neighbours, energies);
+#endif
+
+    const unsigned int* partners;
+    const unsigned int* potentials;
+    unsigned int nBonds = bonds->getBonds(particle, partners, potentials);
+
+    // Skip the search for particles without bonds.
+    if (nBonds == 0) return;
+
+    // Add the energy of any bonds with each neighbour (in a single pass over the bonds).
+    for (unsigned int i=0;i<nNeighbours;i++)
+    {
+        for (unsigned int j=0;j<nBonds;j++)
+        {
+            if (partners[j] == neighbours[i])
+            {
+                energies[i] += bonds->computeBondEnergy(potentials[j],
+                    this->box.computeSquaredDistance(position, &this->particles[neighbours[i]].position[0]));
+            }
+        }
+    }
+}
+
+template <class NonBonded>
+void BondedModel<NonBonded>::reorder(const unsigned int* order)
+{
+    NonBonded::reorder(order);
+    bonds->reorder(order);
+}
+
+template <class NonBonded>
+double BondedModel<NonBonded>::getEnergy()
+{
+    double energy = 0;
+
+    // Model::getEnergy only visits pairs within the cell stencil, so would miss
+    // bonded partners beyond the cut-off. Instead, sum the particle energies,
+    // i.e. the (statically dispatched) non-bonded energies plus the bonds of
+    // each particle from computeBondedEnergy, which count each pair twice.
+    for (unsigned int i=0;i<this->particles.size();i++)
+    {
+        const Particle& particle = this->particles[i];
+
+#ifndef ISOTROPIC
+        energy += computeEnergy(i, &particle.position[0], particle.type, &particle.orientation[0]);
+#else
+        energy += computeEnergy(i, &particle.position[0], particle.type);
+#endif
+    }
+
+    return 0.5*energy/this->particles.size();
+}
+
+template <class NonBonded>
+double BondedModel<NonBonded>::computeBondedEnergy(unsigned int particle, const double* position, const char* isMoving) const
+{
+    const unsigned int* partners;
+    const unsigned int* potentials;
+    unsigned int nBonds = bonds->getBonds(particle, partners, potentials);
+
+    double energy = 0;
+
+    for (unsigned int i=0;i<nBonds;i++)
+    {
+        // Partner is part of the moving cluster.
+        if ((isMoving != nullptr) && isMoving[partners[i]]) continue;
+
+        energy += bonds->computeBondEnergy(potentials[i],
+            this->box.computeSquaredDistance(position, &this->particles[partners[i]].position[0]));
+    }
+
+    return energy;
+}
+
+template <class NonBonded>
+unsigned int BondedModel<NonBonded>::appendPartners(unsigned int particle,
+    unsigned int* interactions, unsigned int nInteractions) const
+{
+    const unsigned int* partners;
+    const unsigned int* potentials;
+    unsigned int nBonds = bonds->getBonds(particle, partners, potentials);
+
+    for (unsigned int i=0;i<nBonds;i++)
+    {
+        if (findInteraction(partners[i], interactions, nInteractions) == nInteractions)
+        {
+            if (nInteractions == this->maxInteractions)
+            {
+                std::cerr << "[ERROR] BondedModel: Maximum number of interactions exceeded!\n";
+                exit(EXIT_FAILURE);
+            }
+
+            interactions[nInteractions] = partners[i];
+            nInteractions++;
+        }
+    }
+
+    return nInteractions;
+}
+
+template <class NonBonded>
+unsigned int BondedModel<NonBonded>::findInteraction(unsigned int particle,
+    const unsigned int* interactions, unsigned int nInteractions)
+{
+    for (unsigned int i=0;i<nInteractions;i++)
+        if (interactions[i] == particle) return i;
+
+    return nInteractions;
+}
+
+#endif  /* _BONDEDMODEL_H */
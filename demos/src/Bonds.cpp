@@ -0,0 +1,218 @@
+/*
+  Copyright (c) 2015-2016 Lester Hedges <lester.hedges+vmmc@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "Bonds.h"
+#include "Model.h"
+
+Bonds::Bonds() : nParticles(0), maxDegree(0)
+{
+}
+
+unsigned int Bonds::addPotential(const Parameters& parameters_)
+{
+    if (parameters_.stiffness < 0)
+    {
+        std::cerr << "[ERROR] Bonds: Bond stiffness must be >= 0!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    if (parameters_.length <= 0)
+    {
+        std::cerr << "[ERROR] Bonds: Bond length must be > 0!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    parameters.push_back(parameters_);
+
+    return parameters.size() - 1;
+}
+
+void Bonds::addBond(unsigned int particle1, unsigned int particle2, unsigned int potential)
+{
+    if (particle1 == particle2)
+    {
+        std::cerr << "[ERROR] Bonds: A particle can't be bonded to itself!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    if (potential >= parameters.size())
+    {
+        std::cerr << "[ERROR] Bonds: Invalid bond potential " << potential << "!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    bondList.push_back(particle1);
+    bondList.push_back(particle2);
+    bondList.push_back(potential);
+}
+
+void Bonds::addFilament(unsigned int first, unsigned int length, unsigned int stretch, unsigned int bend)
+{
+    addFilament(first, length, stretch);
+
+    // Springs between second neighbours resist bending.
+    for (unsigned int i=2;i<length;i++)
+        addBond(first + i - 2, first + i, bend);
+}
+
+void Bonds::addFilament(unsigned int first, unsigned int length, unsigned int stretch)
+{
+    for (unsigned int i=1;i<length;i++)
+        addBond(first + i - 1, first + i, stretch);
+}
+
+void Bonds::build(unsigned int nParticles_)
+{
+    nParticles = nParticles_;
+
+    unsigned int nBonds = bondList.size()/3;
+
+    // Count the bonds of each particle.
+    offsets.assign(nParticles + 1, 0);
+
+    for (unsigned int i=0;i<nBonds;i++)
+    {
+        unsigned int particle1 = bondList[3*i];
+        unsigned int particle2 = bondList[3*i + 1];
+
+        if ((particle1 >= nParticles) || (particle2 >= nParticles))
+        {
+            std::cerr << "[ERROR] Bonds: Bonded particle index exceeds the number of particles!\n";
+            exit(EXIT_FAILURE);
+        }
+
+        offsets[particle1 + 1]++;
+        offsets[particle2 + 1]++;
+    }
+
+    // Work out the start of the bonds of each particle.
+    maxDegree = 0;
+    for (unsigned int i=0;i<nParticles;i++)
+    {
+        maxDegree = std::max(maxDegree, offsets[i + 1]);
+        offsets[i + 1] += offsets[i];
+    }
+
+    // Store each bond in both directions.
+    partners.resize(2*nBonds);
+    potentials.resize(2*nBonds);
+
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+
+    for (unsigned int i=0;i<nBonds;i++)
+    {
+        unsigned int particle1 = bondList[3*i];
+        unsigned int particle2 = bondList[3*i + 1];
+        unsigned int potential = bondList[3*i + 2];
+
+        partners[fill[particle1]] = particle2;
+        potentials[fill[particle1]] = potential;
+        fill[particle1]++;
+
+        partners[fill[particle2]] = particle1;
+        potentials[fill[particle2]] = potential;
+        fill[particle2]++;
+    }
+}
+
+unsigned int Bonds::getBonds(unsigned int particle, const unsigned int*& partners_, const unsigned int*& potentials_) const
+{
+    unsigned int start = offsets[particle];
+
+    partners_ = partners.data() + start;
+    potentials_ = potentials.data() + start;
+
+    return offsets[particle + 1] - start;
+}
+
+unsigned int Bonds::getDegree(unsigned int particle) const
+{
+    return offsets[particle + 1] - offsets[particle];
+}
+
+unsigned int Bonds::getMaxDegree() const
+{
+    return maxDegree;
+}
+
+unsigned int Bonds::getNumBonds() const
+{
+    return bondList.size()/3;
+}
+
+bool Bonds::isBonded(unsigned int particle1, unsigned int particle2) const
+{
+    for (unsigned int i=offsets[particle1];i<offsets[particle1 + 1];i++)
+        if (partners[i] == particle2) return true;
+
+    return false;
+}
+
+double Bonds::computeBondEnergy(unsigned int potential, double normSqd) const
+{
+    const Parameters& bond = parameters[potential];
+
+    if (bond.potential == HARMONIC)
+    {
+        double extension = std::sqrt(normSqd) - bond.length;
+
+        return 0.5*bond.stiffness*extension*extension;
+    }
+    else
+    {
+        double squaredMaxLength = bond.length*bond.length;
+
+        // Bond can't be extended beyond the maximum length.
+        if (normSqd >= squaredMaxLength) return INF;
+
+        return -0.5*bond.stiffness*squaredMaxLength*std::log(1.0 - normSqd/squaredMaxLength);
+    }
+}
+
+double Bonds::computePairEnergy(unsigned int particle1, unsigned int particle2, double normSqd) const
+{
+    double energy = 0;
+
+    // Sum over all bonds between the pair (there may be more than one potential).
+    for (unsigned int i=offsets[particle1];i<offsets[particle1 + 1];i++)
+        if (partners[i] == particle2) energy += computeBondEnergy(potentials[i], normSqd);
+
+    return energy;
+}
+
+void Bonds::reorder(const unsigned int* order)
+{
+    // The new index of each particle.
+    std::vector<unsigned int> newIndex(nParticles);
+
+    for (unsigned int i=0;i<nParticles;i++)
+        newIndex[order[i]] = i;
+
+    // Relabel the bonded particles, then recompile.
+    for (unsigned int i=0;i<bondList.size()/3;i++)
+    {
+        bondList[3*i] = newIndex[bondList[3*i]];
+        bondList[3*i + 1] = newIndex[bondList[3*i + 1]];
+    }
+
+    build(nParticles);
+}
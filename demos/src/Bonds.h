@@ -0,0 +1,209 @@
+/*
+  Copyright (c) 2015-2016 Lester Hedges <lester.hedges+vmmc@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _BONDS_H
+#define _BONDS_H
+
+#include <vector>
+
+/*! \file Bonds.h
+*/
+
+//! Class defining a fixed bond topology, e.g. for filaments of particles.
+/*! Bonds are added as pairs of particles, then compiled into compressed
+    sparse row (CSR) form, i.e. the bonds of each particle are stored
+    contiguously, so that looking up the bonds of a particle is O(degree)
+    and never requires a neighbour search. Each bond refers to an entry
+    in a table of bond potentials.
+
+    Bending stiffness is modelled with a spring between second neighbours
+    along a filament, i.e. particles i and i+2, which keeps every bonded
+    term pairwise and so compatible with the VMMC energy callbacks.
+ */
+class Bonds
+{
+public:
+    //! Bond potential forms.
+    enum Potential
+    {
+        HARMONIC,   //!< Harmonic spring, 0.5*k*(r - r0)^2.
+        FENE        //!< Finitely extensible nonlinear elastic, -0.5*k*R0^2*ln(1 - (r/R0)^2).
+    };
+
+    //! Parameters of a bond potential.
+    struct Parameters
+    {
+        Potential potential;        //!< The potential form.
+        double stiffness;           //!< The spring constant, k (in units of kBT).
+        double length;              //!< The rest length, r0 (harmonic), or maximum extension, R0 (FENE).
+    };
+
+    //! Constructor.
+    Bonds();
+
+    //! Add a bond potential to the table.
+    /*! \param parameters
+            The parameters of the potential.
+
+        \return
+            The index of the potential.
+     */
+    unsigned int addPotential(const Parameters&);
+
+    //! Add a bond between two particles.
+    /*! \param particle1
+            The index of the first particle.
+
+        \param particle2
+            The index of the second particle.
+
+        \param potential
+            The index of the bond potential.
+     */
+    void addBond(unsigned int, unsigned int, unsigned int);
+
+    //! Add the bonds of a linear filament of consecutively indexed particles.
+    /*! \param first
+            The index of the first particle in the filament.
+
+        \param length
+            The number of particles in the filament.
+
+        \param stretch
+            The index of the potential between neighbouring particles.
+
+        \param bend
+            The index of the potential between second neighbours (bending).
+     */
+    void addFilament(unsigned int, unsigned int, unsigned int, unsigned int);
+
+    //! Add the bonds of a linear filament of consecutively indexed particles, without bending stiffness.
+    /*! \param first
+            The index of the first particle in the filament.
+
+        \param length
+            The number of particles in the filament.
+
+        \param stretch
+            The index of the potential between neighbouring particles.
+     */
+    void addFilament(unsigned int, unsigned int, unsigned int);
+
+    //! Compile the bonds into compressed sparse row form.
+    /*! Must be called once all bonds have been added (BondedModel does this on construction).
+
+        \param nParticles
+            The number of particles.
+     */
+    void build(unsigned int);
+
+    //! Get the bonds of a particle.
+    /*! \param particle
+            The particle index.
+
+        \param partners
+            A pointer to the indices of the bonded partners.
+
+        \param potentials
+            A pointer to the potential index of each bond.
+
+        \return
+            The number of bonds.
+     */
+    unsigned int getBonds(unsigned int, const unsigned int*&, const unsigned int*&) const;
+
+    //! Get the number of bonds of a particle.
+    /*! \param particle
+            The particle index.
+
+        \return
+            The number of bonds.
+     */
+    unsigned int getDegree(unsigned int) const;
+
+    //! Get the largest number of bonds of any particle.
+    /*! \return
+            The maximum degree.
+     */
+    unsigned int getMaxDegree() const;
+
+    //! Get the total number of bonds.
+    /*! \return
+            The number of bonds.
+     */
+    unsigned int getNumBonds() const;
+
+    //! Determine whether two particles are bonded.
+    /*! \param particle1
+            The index of the first particle.
+
+        \param particle2
+            The index of the second particle.
+
+        \return
+            Whether the particles are bonded.
+     */
+    bool isBonded(unsigned int, unsigned int) const;
+
+    //! Calculate the energy of a bond.
+    /*! \param potential
+            The index of the bond potential.
+
+        \param normSqd
+            The squared separation of the bonded particles.
+
+        \return
+            The bond energy (infinite if a FENE bond is over-extended).
+     */
+    double computeBondEnergy(unsigned int, double) const;
+
+    //! Calculate the total bond energy between two particles.
+    /*! \param particle1
+            The index of the first particle.
+
+        \param particle2
+            The index of the second particle.
+
+        \param normSqd
+            The squared separation of the particles.
+
+        \return
+            The bond energy (zero if the particles aren't bonded).
+     */
+    double computePairEnergy(unsigned int, unsigned int, double) const;
+
+    //! Apply a new particle ordering, e.g. following a call to VMMC::reorder.
+    /*! \param order
+            The new particle ordering: order[i] is the previous index of the
+            particle that now has index i.
+     */
+    void reorder(const unsigned int*);
+
+private:
+    std::vector<Parameters> parameters;         //!< The table of bond potentials.
+
+    std::vector<unsigned int> bondList;         //!< Bonds as they are added (particle, partner, potential).
+
+    std::vector<unsigned int> offsets;          //!< The start of the bonds of each particle (one entry per particle, plus one).
+    std::vector<unsigned int> partners;         //!< The bonded partner of each bond (both directions).
+    std::vector<unsigned int> potentials;       //!< The potential index of each bond (both directions).
+
+    unsigned int nParticles;                    //!< The number of particles.
+    unsigned int maxDegree;                     //!< The largest number of bonds of any particle.
+};
+
+#endif  /* _BONDS_H */
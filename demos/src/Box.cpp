@@ -33,14 +33,12 @@ Box::Box(const std::vector<double>& boxSize_) :
     }
 
     isPeriodic.resize(dimension);
-    posMinImage.resize(dimension);
-    negMinImage.resize(dimension);
+    inverseBoxSize.resize(dimension);
 
     for (unsigned int i=0;i<dimension;i++)
     {
         isPeriodic[i] = true;
-        posMinImage[i] = 0.5*boxSize[i];
-        negMinImage[i] = -0.5*boxSize[i];
+        inverseBoxSize[i] = 1.0/boxSize[i];
     }
 }
 
@@ -57,48 +55,31 @@ Box::Box(const std::vector<double>& boxSize_, const std::vector<bool>& isPeriodi
         exit(EXIT_FAILURE);
     }
 
-    posMinImage.resize(dimension);
-    negMinImage.resize(dimension);
+    inverseBoxSize.resize(dimension);
 
     for (unsigned int i=0;i<dimension;i++)
     {
-        posMinImage[i] = 0.5*boxSize[i];
-        negMinImage[i] = -0.5*boxSize[i];
+        inverseBoxSize[i] = isPeriodic[i] ? 1.0/boxSize[i] : 0;
     }
 }
 
-void Box::periodicBoundaries(std::vector<double>& coord)
+void Box::setBoxSize(const std::vector<double>& boxSize_)
 {
-    for (unsigned int i=0;i<dimension;i++)
+    if (boxSize_.size() != dimension)
     {
-        if (coord[i] < 0)
-        {
-            coord[i] += boxSize[i];
-        }
-        else
-        {
-            if (coord[i] >= boxSize[i])
-            {
-                coord[i] -= boxSize[i];
-            }
-        }
+        std::cerr << "[ERROR] Box: Invalid dimensionality!\n";
+        exit(EXIT_FAILURE);
     }
-}
 
-void Box::minimumImage(std::vector<double>& separation)
-{
+    boxSize = boxSize_;
+
     for (unsigned int i=0;i<dimension;i++)
     {
-        if (separation[i] < negMinImage[i])
-        {
-            separation[i] += isPeriodic[i]*boxSize[i];
-        }
-        else
-        {
-            if (separation[i] >= posMinImage[i])
-            {
-                separation[i] -= isPeriodic[i]*boxSize[i];
-            }
-        }
+        inverseBoxSize[i] = isPeriodic[i] ? 1.0/boxSize[i] : 0;
     }
 }
+
+const std::vector<double>& Box::getInverseBoxSize() const
+{
+    return inverseBoxSize;
+}
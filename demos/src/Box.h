@@ -18,6 +18,7 @@
 #ifndef _BOX_H
 #define _BOX_H
 
+#include <cmath>
 #include <vector>
 
 /*! \file Box.h
@@ -45,25 +46,183 @@ public:
      */
     Box(const std::vector<double>&, const std::vector<bool>&);
 
-    //! Apply periodic boundary conditions.
+    //! Resize the simulation box, e.g. following a volume move.
+    /*! \param boxSize_
+            Vector containing the new x,y,z size of box.
+     */
+    void setBoxSize(const std::vector<double>&);
+
+    //! Apply periodic boundary conditions (along periodic axes only).
     /* \param coord
             x,y,z coordinate vector.
      */
-    void periodicBoundaries(std::vector<double>&);
+    void periodicBoundaries(std::vector<double>&) const;
+
+    //! Apply periodic boundary conditions (along periodic axes only).
+    /*! The wrap is branchless, i.e. x -= L*floor(x/L).
+
+        \param coord
+            Pointer to the x,y,z coordinates.
+     */
+    void periodicBoundaries(double*) const;
+
+    //! Apply periodic boundary conditions to packed coordinates.
+    /*! \param coords
+            Pointer to the coordinates (dimension entries per point).
+
+        \param nPoints
+            The number of points.
+     */
+    void periodicBoundaries(double*, unsigned int) const;
 
     //! Compute minimum image separation.
     /*! \param separation
             x,y,z separation vector.
      */
-    void minimumImage(std::vector<double>&);
+    void minimumImage(std::vector<double>&) const;
+
+    //! Compute minimum image separation.
+    /*! The image is selected without branches, i.e. x -= L*rint(x/L).
+
+        \param separation
+            Pointer to the x,y,z separation.
+     */
+    void minimumImage(double*) const;
+
+    //! Compute minimum image separations for packed separation vectors.
+    /*! \param separations
+            Pointer to the separations (dimension entries per vector).
+
+        \param nVectors
+            The number of separation vectors.
+     */
+    void minimumImage(double*, unsigned int) const;
+
+    //! Compute the minimum image separation between two points.
+    /*! \param position1
+            The coordinates of the first point.
+
+        \param position2
+            The coordinates of the second point.
+
+        \param separation
+            Array to store the separation, position1 - position2 (dimension entries).
+
+        \return
+            The squared norm of the separation.
+     */
+    double computeSeparation(const double*, const double*, double*) const;
+
+    //! Compute the squared minimum image distance between two points.
+    /*! \param position1
+            The coordinates of the first point.
+
+        \param position2
+            The coordinates of the second point.
+
+        \return
+            The squared distance.
+     */
+    double computeSquaredDistance(const double*, const double*) const;
+
+    //! Compute the squared minimum image distances from a point to packed points.
+    /*! \param position
+            The coordinates of the point.
+
+        \param positions
+            Pointer to the coordinates of the other points (dimension entries per point).
+
+        \param nPoints
+            The number of other points.
+
+        \param squaredDistances
+            Array to store the squared distance to each point.
+     */
+    void computeSquaredDistances(const double*, const double*, unsigned int, double*) const;
+
+    //! Get the inverse size of the box along each axis.
+    /*! \return
+            The inverse box size (zero along non-periodic axes), e.g. for the
+            branchless minimum image x -= L*rint(x/L).
+     */
+    const std::vector<double>& getInverseBoxSize() const;
 
     std::vector<double> boxSize;        //!< Size of the box in x,y,z directions.
     unsigned int dimension;             //!< Dimensionality of the simulation box.
 
 private:
     std::vector<bool>   isPeriodic;     //!< Whether the box is periodic across each boundary.
-    std::vector<double> posMinImage;    //!< Minimum image condition in each dimension.
-    std::vector<double> negMinImage;    //!< Negative minimum image condition in each dimension.
+    std::vector<double> inverseBoxSize; //!< Inverse box size in each dimension (zero if not periodic).
 };
 
+inline void Box::periodicBoundaries(std::vector<double>& coord) const
+{
+    periodicBoundaries(&coord[0]);
+}
+
+inline void Box::periodicBoundaries(double* coord) const
+{
+    // The inverse box size is zero along non-periodic axes, so no wrap is applied.
+    for (unsigned int i=0;i<dimension;i++)
+        coord[i] -= boxSize[i]*std::floor(coord[i]*inverseBoxSize[i]);
+}
+
+inline void Box::periodicBoundaries(double* coords, unsigned int nPoints) const
+{
+    for (unsigned int i=0;i<nPoints;i++)
+        periodicBoundaries(coords + i*dimension);
+}
+
+inline void Box::minimumImage(std::vector<double>& separation) const
+{
+    minimumImage(&separation[0]);
+}
+
+inline void Box::minimumImage(double* separation) const
+{
+    for (unsigned int i=0;i<dimension;i++)
+        separation[i] -= boxSize[i]*std::rint(separation[i]*inverseBoxSize[i]);
+}
+
+inline void Box::minimumImage(double* separations, unsigned int nVectors) const
+{
+    for (unsigned int i=0;i<nVectors;i++)
+        minimumImage(separations + i*dimension);
+}
+
+inline double Box::computeSeparation(const double* position1, const double* position2, double* separation) const
+{
+    double normSqd = 0;
+
+    for (unsigned int i=0;i<dimension;i++)
+    {
+        separation[i] = position1[i] - position2[i];
+        separation[i] -= boxSize[i]*std::rint(separation[i]*inverseBoxSize[i]);
+        normSqd += separation[i]*separation[i];
+    }
+
+    return normSqd;
+}
+
+inline double Box::computeSquaredDistance(const double* position1, const double* position2) const
+{
+    double normSqd = 0;
+
+    for (unsigned int i=0;i<dimension;i++)
+    {
+        double sep = position1[i] - position2[i];
+        sep -= boxSize[i]*std::rint(sep*inverseBoxSize[i]);
+        normSqd += sep*sep;
+    }
+
+    return normSqd;
+}
+
+inline void Box::computeSquaredDistances(const double* position, const double* positions,
+    unsigned int nPoints, double* squaredDistances) const
+{
+    for (unsigned int i=0;i<nPoints;i++)
+        squaredDistances[i] = computeSquaredDistance(position, positions + i*dimension);
+}
+
 #endif  /* _BOX_H */
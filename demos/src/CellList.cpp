@@ -18,6 +18,7 @@
 #include <cmath>
 #include <cstdlib>
 #include <iostream>
+#include <limits>
 
 #include "CellList.h"
 #include "Particle.h"
@@ -26,72 +27,532 @@
     #define M_PI 3.1415926535897932384626433832795
 #endif
 
-CellList::CellList() : dimension(3)
+CellList::CellList() :
+    dimension(3),
+    nCells(0),
+    nBlocks(0),
+    maxParticles(0),
+    subdivisions(1),
+    nTypes(0),
+    strategy(AUTOMATIC),
+    activeStrategy(CELLS),
+    verletSkin(0.3),
+    verletInterval(VERLET_INTERVAL),
+    nUpdates(0),
+    isStale(false)
 {
 }
 
-CellList::CellList(unsigned int dimension_, const std::vector<double>& boxSize, double range) : dimension(dimension_)
+CellList::CellList(unsigned int dimension_, const std::vector<double>& boxSize_, double range_) :
+    dimension(dimension_),
+    nBlocks(0),
+    nTypes(0),
+    strategy(AUTOMATIC),
+    activeStrategy(CELLS),
+    verletSkin(0.3),
+    verletInterval(VERLET_INTERVAL),
+    nUpdates(0),
+    isStale(false)
 {
-    this->initialise(boxSize, range);
+    this->initialise(boxSize_, range_);
 }
 
-CellList& CellList::operator = (const CellList& cells)
+void CellList::initialise(const std::vector<double>& boxSize_, double range_, unsigned int nParticles_, unsigned int subdivisions_)
 {
-    // resize cell list
-    (*this).resize(cells.size());
+    // Default to a fully periodic box.
+    if (isPeriodic.empty()) isPeriodic.assign(dimension, true);
+    else if (isPeriodic.size() != dimension)
+    {
+        std::cerr << "[ERROR] CellList: Periodicity must be set for each dimension!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    boxSize = boxSize_;
+    range = range_;
+    nParticles = nParticles_;
+    requestedSubdivisions = subdivisions_;
+
+    selectStrategy();
+    buildGrid();
+}
+
+void CellList::reset()
+{
+    tally.assign(nCells, 0);
+    typeTally.assign(nCells*nTypes, 0);
+}
+
+int CellList::getCell(const Particle& particle)
+{
+    int cell,cellx,celly;
+
+    cellx = int(particle.position[0]/cellSpacing[0]);
+    celly = int(particle.position[1]/cellSpacing[1]);
+
+    // Particles can sit exactly on a non-periodic boundary.
+    if (cellx == (int) cellsPerAxis[0]) cellx--;
+    if (celly == (int) cellsPerAxis[1]) celly--;
 
-    // copy across individual cells
-    for (unsigned int i=0;i<cells.size();i++)
+    cell = cellx + celly*cellsPerAxis[0];
+
+    if (dimension == 3)
     {
-        at(i) = cells[i];
+        int cellz = int(particle.position[2]/cellSpacing[2]);
+        if (cellz == (int) cellsPerAxis[2]) cellz--;
+        cell += cellz*cellsPerAxis[0]*cellsPerAxis[1];
     }
 
-    return *this;
+    return cell;
 }
 
-CellList& CellList::operator = (const std::vector<Cell>& cells)
+void CellList::initCell(int newCell, Particle& particle)
 {
-    // resize cell list
-    (*this).resize(cells.size());
+    if (region[newCell] == OUTSIDE)
+    {
+        std::cerr << "[ERROR] CellList: Particle lies in a masked cell!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    // Grow the blocks if the cell is full. This only happens during
+    // initialisation, e.g. when inactive particles are stacked in one cell.
+    if (tally[newCell] == maxParticles) resizeCells(2*maxParticles);
+
+    // Add to new list
+    cellParticles[blockIndex[newCell]*maxParticles + tally[newCell]] = particle.index;
+    particle.cell = newCell;
+    particle.posCell = tally[newCell];
+    tally[newCell]++;
 
-    // copy across individual cells
-    for (unsigned int i=0;i<cells.size();i++)
+    if (nTypes > 0)
     {
-        at(i) = cells[i];
+        if (particle.type >= nTypes)
+        {
+            std::cerr << "[ERROR] CellList: Particle type exceeds number of types!\n";
+            exit(EXIT_FAILURE);
+        }
+
+        if (particle.index >= posType.size()) posType.resize(particle.index + 1);
+
+        // Add to new per-type list
+        unsigned int block = newCell*nTypes + particle.type;
+        typeParticles[(blockIndex[newCell]*nTypes + particle.type)*maxParticles + typeTally[block]] = particle.index;
+        posType[particle.index] = typeTally[block];
+        typeTally[block]++;
     }
+}
+
+void CellList::initCellList(std::vector<Particle>& particles)
+{
+    int nParticles_ = particles.size();
+
+    // Cell index of each particle.
+    std::vector<unsigned int> particleCells(nParticles_);
 
-    return *this;
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int i=0;i<nParticles_;i++)
+        particleCells[i] = getCell(particles[i]);
+
+    // Count the particles in each cell.
+    unsigned int maxTally = 0;
+    tally.assign(nCells, 0);
+
+    for (int i=0;i<nParticles_;i++)
+    {
+        unsigned int cell = particleCells[i];
+
+        if (region[cell] == OUTSIDE)
+        {
+            std::cerr << "[ERROR] CellList: Particle lies in a masked cell!\n";
+            exit(EXIT_FAILURE);
+        }
+
+        if ((nTypes > 0) && (particles[i].type >= nTypes))
+        {
+            std::cerr << "[ERROR] CellList: Particle type exceeds number of types!\n";
+            exit(EXIT_FAILURE);
+        }
+
+        tally[cell]++;
+        if (tally[cell] > maxTally) maxTally = tally[cell];
+    }
+
+    // Grow the blocks if a cell is too full, e.g. when inactive particles
+    // are stacked in one cell. (The blocks are refilled from scratch.)
+    if (maxTally > maxParticles)
+    {
+        while (maxParticles < maxTally) maxParticles *= 2;
+        cellParticles.resize(nBlocks*maxParticles);
+        typeParticles.resize(nBlocks*nTypes*maxParticles);
+    }
+
+    typeTally.assign(nCells*nTypes, 0);
+    if (nTypes > 0) posType.resize(nParticles_);
+
+    // Offset of each cell in the sorted particle order (prefix sum).
+    std::vector<unsigned int> cellStart(nCells + 1);
+    cellStart[0] = 0;
+    for (unsigned int i=0;i<nCells;i++)
+        cellStart[i+1] = cellStart[i] + tally[i];
+
+    // Counting sort of particles by cell (stable, i.e. in index order within each cell).
+    std::vector<unsigned int> sortedParticles(nParticles_);
+    std::vector<unsigned int> cursor(cellStart.begin(), cellStart.end() - 1);
+    for (int i=0;i<nParticles_;i++)
+        sortedParticles[cursor[particleCells[i]]++] = i;
+
+    // Scatter the particles of each cell into its block. Cells are independent,
+    // so this can be done in parallel.
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int i=0;i<(int) nCells;i++)
+    {
+        unsigned int* block = cellParticles.data() + blockIndex[i]*maxParticles;
+
+        for (unsigned int j=0;j<tally[i];j++)
+        {
+            unsigned int particle = sortedParticles[cellStart[i] + j];
+
+            block[j] = particle;
+            particles[particle].cell = i;
+            particles[particle].posCell = j;
+
+            if (nTypes > 0)
+            {
+                unsigned int type = particles[particle].type;
+                unsigned int& typeCount = typeTally[i*nTypes + type];
+
+                typeParticles[(blockIndex[i]*nTypes + type)*maxParticles + typeCount] = particle;
+                posType[particle] = typeCount;
+                typeCount++;
+            }
+        }
+    }
+
+    initNeighbourLists(particles);
 }
 
-void CellList::initialise(const std::vector<double>& boxSize, double range)
+void CellList::initNeighbourLists(std::vector<Particle>& particles)
 {
-    unsigned int i,j,k,m;
-    unsigned int a,b,c;
-    unsigned int x,y,z;
-    unsigned int nn,nnCount;
+    if (activeStrategy == VERLET) buildVerletLists(particles);
+}
 
-    cellsPerAxis.resize(dimension);
-    cellSpacing.resize(dimension);
+void CellList::updateCell(int newCell, Particle& particle, std::vector<Particle>& particles)
+{
+    if (region[newCell] == OUTSIDE)
+    {
+        std::cerr << "[ERROR] CellList: Particle lies in a masked cell!\n";
+        exit(EXIT_FAILURE);
+    }
 
-    for (i=0;i<dimension;i++)
+    if (tally[newCell] == maxParticles)
     {
-        cellsPerAxis[i] = 1;
+        std::cerr << "[ERROR] CellList: Maximum number of particles per cell exceeded!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    unsigned int* oldParticles = &cellParticles[blockIndex[particle.cell]*maxParticles];
+
+    // Remove from old list
+    tally[particle.cell]--;
+    oldParticles[particle.posCell] = oldParticles[tally[particle.cell]];
+    particles[oldParticles[tally[particle.cell]]].posCell = particle.posCell;
+
+    if (nTypes > 0)
+    {
+        unsigned int block = particle.cell*nTypes + particle.type;
+        unsigned int* oldTypeParticles = &typeParticles[(blockIndex[particle.cell]*nTypes + particle.type)*maxParticles];
+
+        // Remove from old per-type list
+        typeTally[block]--;
+        unsigned int last = oldTypeParticles[typeTally[block]];
+        oldTypeParticles[posType[particle.index]] = last;
+        posType[last] = posType[particle.index];
+
+        // Add to new per-type list
+        block = newCell*nTypes + particle.type;
+        typeParticles[(blockIndex[newCell]*nTypes + particle.type)*maxParticles + typeTally[block]] = particle.index;
+        posType[particle.index] = typeTally[block];
+        typeTally[block]++;
+    }
+
+    // Add to new list
+    cellParticles[blockIndex[newCell]*maxParticles + tally[newCell]] = particle.index;
+    particle.cell = newCell;
+    particle.posCell = tally[newCell];
+    tally[newCell]++;
+}
+
+void CellList::updateParticle(Particle& particle, std::vector<Particle>& particles)
+{
+    unsigned int newCell = getCell(particle);
+
+    // Update cell lists if necessary.
+    if (particle.cell != newCell)
+        updateCell(newCell, particle, particles);
+
+    if (activeStrategy == VERLET)
+    {
+        nUpdates++;
+
+        // Once a particle has moved more than half of the skin, a pair that
+        // was beyond the list range could now be within the interaction range.
+        double normSqd = computeSquaredDistance(&particle.position[0], &verletPositions[dimension*particle.index]);
+
+        // The rebuild is deferred until the next neighbour query, so that a
+        // cluster move costs at most one rebuild however many particles move.
+        if (4*normSqd > verletSkin*verletSkin)
+            isStale = true;
+    }
+}
+
+void CellList::rescale(const std::vector<double>& boxSize_, std::vector<Particle>& particles)
+{
+    boxSize = boxSize_;
+
+    double searchRange = range;
+    if (activeStrategy == VERLET) searchRange += verletSkin;
+
+    double minSpacing = searchRange / subdivisions;
 
-        while ((boxSize[i] / (double) cellsPerAxis[i]) > range)
+    // Masked cells must be classified again, so only unmasked grids
+    // that keep the same number of cells can be rescaled in place.
+    bool isRescalable = !mask;
+
+    if (activeStrategy != BRUTE_FORCE)
+    {
+        for (unsigned int i=0;i<dimension;i++)
         {
-            cellsPerAxis[i]++;
+            double spacing = boxSize[i] / (double) cellsPerAxis[i];
+            double nextSpacing = boxSize[i] / (double) (cellsPerAxis[i] + 1);
+
+            if ((spacing < minSpacing) || (nextSpacing > minSpacing)) isRescalable = false;
         }
-        cellsPerAxis[i]--;
+    }
+
+    if (!isRescalable)
+    {
+        selectStrategy();
+        buildGrid();
+        initCellList(particles);
+        return;
+    }
+
+    for (unsigned int i=0;i<dimension;i++)
         cellSpacing[i] = boxSize[i] / (double) cellsPerAxis[i];
 
-        // check that number of cells per axis is large enough
-        if (cellsPerAxis[i] < 3)
+    // Cells that were beyond the cut-off may now lie within it (or vice versa).
+    std::vector<int> offsets;
+    computeStencil(searchRange, subdivisions, offsets);
+
+    if (offsets != stencilOffsets)
+    {
+        stencilOffsets.swap(offsets);
+        buildStencils();
+    }
+
+    // Move particles that have changed cell.
+    for (unsigned int i=0;i<particles.size();i++)
+    {
+        unsigned int newCell = getCell(particles[i]);
+
+        if (particles[i].cell != newCell)
         {
-            std::cerr << "[ERROR] CellList: Simulation box is too small (min cells per axis is 3)\n";
-            exit(EXIT_FAILURE);
+            // Fall back to a full rebuild if the cell is full.
+            if (tally[newCell] == maxParticles)
+            {
+                initCellList(particles);
+                return;
+            }
+
+            updateCell(newCell, particles[i], particles);
+        }
+    }
+
+    initNeighbourLists(particles);
+}
+
+void CellList::setDimension(unsigned int dimension_)
+{
+    dimension = dimension_;
+}
+
+void CellList::setPeriodicity(const std::vector<bool>& isPeriodic_)
+{
+    isPeriodic = isPeriodic_;
+}
+
+void CellList::setTypes(unsigned int nTypes_)
+{
+    nTypes = nTypes_;
+
+    typeTally.assign(nCells*nTypes, 0);
+    typeParticles.assign(nBlocks*nTypes*maxParticles, 0);
+
+    reset();
+}
+
+unsigned int CellList::getTypes() const
+{
+    return nTypes;
+}
+
+unsigned int CellList::getSubdivisions() const
+{
+    return subdivisions;
+}
+
+void CellList::setStrategy(Strategy strategy_)
+{
+    strategy = strategy_;
+}
+
+CellList::Strategy CellList::getStrategy() const
+{
+    return activeStrategy;
+}
+
+void CellList::setVerletSkin(double verletSkin_)
+{
+    if (verletSkin_ <= 0)
+    {
+        std::cerr << "[ERROR] CellList: Verlet skin must be positive!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    verletSkin = verletSkin_;
+}
+
+void CellList::selectStrategy()
+{
+    // The cost estimates below overwrite the grid, so keep a copy.
+    std::vector<unsigned int> cellsPerAxis_ = cellsPerAxis;
+    std::vector<double> cellSpacing_ = cellSpacing;
+
+    double volume = 1;
+    for (unsigned int i=0;i<dimension;i++) volume *= boxSize[i];
+    double density = nParticles / volume;
+
+    // Choose the number of subdivisions automatically.
+    subdivisions = requestedSubdivisions;
+    if (subdivisions == 0)
+    {
+        subdivisions = 1;
+
+        if (nParticles > 0)
+        {
+            double minCost = 0;
+
+            // Pick the grid that minimises the cost of a neighbour query.
+            for (unsigned int k=1;k<=MAX_SUBDIVISIONS;k++)
+            {
+                double cost = estimateCellCost(range, k, density);
+
+                if (!isGridValid(k)) break;
+
+                if ((k == 1) || (cost < minCost))
+                {
+                    minCost = cost;
+                    subdivisions = k;
+                }
+            }
+        }
+    }
+
+    if (strategy != AUTOMATIC)
+    {
+        activeStrategy = strategy;
+        if (activeStrategy == VERLET) subdivisions = 1;
+    }
+    else
+    {
+        setGrid(boxSize, range, 1);
+
+        // The box is too small for cells to be of any use.
+        if (!isGridValid(1)) activeStrategy = BRUTE_FORCE;
+        else
+        {
+            activeStrategy = CELLS;
+
+            // Compare the cost of a query for each strategy (when the density is known).
+            if (nParticles > 0)
+            {
+                double minCost = estimateCellCost(range, subdivisions, density);
+
+                // Every particle is a candidate neighbour.
+                double bruteForceCost = CELL_COST + nParticles;
+
+                if (bruteForceCost < minCost)
+                {
+                    minCost = bruteForceCost;
+                    activeStrategy = BRUTE_FORCE;
+                }
+
+                // Only use Verlet lists when the cell size is free to change.
+                if (requestedSubdivisions == 0)
+                {
+                    if (estimateVerletCost(density) < minCost)
+                    {
+                        activeStrategy = VERLET;
+                        subdivisions = 1;
+                    }
+                }
+            }
         }
     }
 
+    cellsPerAxis = cellsPerAxis_;
+    cellSpacing = cellSpacing_;
+}
+
+double CellList::estimateCellCost(double searchRange, unsigned int subdivisions_, double density)
+{
+    setGrid(boxSize, searchRange, subdivisions_);
+
+    std::vector<int> offsets;
+    unsigned int nStencil = computeStencil(searchRange, subdivisions_, offsets);
+
+    double cellVolume = 1;
+    for (unsigned int i=0;i<dimension;i++) cellVolume *= cellSpacing[i];
+
+    // The number of stencil cells times the cost of visiting each one.
+    return nStencil*(CELL_COST + density*cellVolume);
+}
+
+double CellList::estimateVerletCost(double density)
+{
+    double listRange = range + verletSkin;
+
+    // Lists are built from a grid at the list range.
+    double buildCost = estimateCellCost(listRange, 1, density);
+    if (!isGridValid(1)) return std::numeric_limits<double>::max();
+
+    double listVolume;
+    if (dimension == 3) listVolume = (4.0/3.0)*M_PI*listRange*listRange*listRange;
+    else listVolume = M_PI*listRange*listRange;
+
+    // The cost of a query plus that of the rebuilds, amortised over the
+    // queries made between them.
+    return CELL_COST + density*listVolume + buildCost/(QUERIES_PER_UPDATE*verletInterval);
+}
+
+void CellList::buildGrid()
+{
+    // Verlet lists are built from a grid at the list range.
+    double searchRange = range;
+    if (activeStrategy == VERLET) searchRange += verletSkin;
+
+    if (activeStrategy == BRUTE_FORCE)
+    {
+        // A single cell that holds every particle.
+        subdivisions = 1;
+        cellsPerAxis.assign(dimension, 1);
+        cellSpacing = boxSize;
+    }
+    else setGrid(boxSize, searchRange, subdivisions);
+
     // Estimate maximum number of particles per cell from interaction range.
     // (Assumes particle diameter is one.)
     if (dimension == 3) maxParticles = (cellSpacing[0]*cellSpacing[1]*cellSpacing[2]) / ((4.0/3.0)*M_PI*0.5*0.5*0.5);
@@ -100,182 +561,418 @@ void CellList::initialise(const std::vector<double>& boxSize, double range)
     // Add a buffer, e.g. if particles can overlap.
     maxParticles += 10;
 
+    // A single cell never needs to hold more than every particle.
+    if ((activeStrategy == BRUTE_FORCE) && (nParticles > 0)) maxParticles = nParticles;
+
     nCells = cellsPerAxis[0]*cellsPerAxis[1];
     if (dimension == 3) nCells *= cellsPerAxis[2];
 
-    // resize cell list array
-    (*this).resize(nCells);
+    // Stencil offsets, ordered lexicographically.
+    computeStencil(searchRange, subdivisions, stencilOffsets);
 
-    if (dimension == 3)
+    region.assign(nCells, INSIDE);
+    if (mask) classifyCells();
+
+    allocateCells();
+    buildStencils();
+}
+
+void CellList::buildVerletLists(const std::vector<Particle>& particles)
+{
+    isStale = false;
+
+    unsigned int nGroups = (nTypes > 0) ? nTypes : 1;
+    double cutOffSqd = (range + verletSkin)*(range + verletSkin);
+
+    // Neighbours of the current particle.
+    std::vector<unsigned int> neighbours;
+
+    verletStart.resize(particles.size()*nGroups + 1);
+    verletParticles.clear();
+    verletPositions.resize(dimension*particles.size());
+
+    for (unsigned int i=0;i<particles.size();i++)
     {
-        nNeighbours = 27;
+        const double* position = &particles[i].position[0];
 
-        // loop over all cells x direction
-        for (i=0;i<cellsPerAxis[0];i++)
+        neighbours.clear();
+
+        // Check all neighbouring cells including same cell.
+        const unsigned int* neighbourCells_ = getNeighbourCells(particles[i].cell);
+        unsigned int nNeighbours = getNeighbours(particles[i].cell);
+
+        for (unsigned int j=0;j<nNeighbours;j++)
         {
-            // loop over all cells y direction
-            for (j=0;j<cellsPerAxis[1];j++)
+            unsigned int cell = neighbourCells_[j];
+            const unsigned int* cellParticles_ = getParticles(cell);
+
+            for (unsigned int k=0;k<tally[cell];k++)
             {
-                // loop over all cells z direction
-                for (k=0;k<cellsPerAxis[2];k++)
-                {
-                    // cell index
-                    m = i + cellsPerAxis[0]*j + cellsPerAxis[0]*cellsPerAxis[1]*k;
+                unsigned int neighbour = cellParticles_[k];
 
-                    // resize neighbour list and particle arrays
-                    at(m).neighbours.resize(nNeighbours);
-                    at(m).particles.resize(maxParticles);
+                if ((neighbour != i) && (computeSquaredDistance(position, &particles[neighbour].position[0]) < cutOffSqd))
+                    neighbours.push_back(neighbour);
+            }
+        }
 
-                    nnCount = 0;
+        // Store the list, grouped by type if there is per-type occupancy.
+        for (unsigned int j=0;j<nGroups;j++)
+        {
+            verletStart[i*nGroups + j] = verletParticles.size();
 
-                    // x loop for nearest neighbours
-                    for (a=0;a<3;a++)
-                    {
-                        x = (i+(a-1)+cellsPerAxis[0])%cellsPerAxis[0];
+            for (unsigned int k=0;k<neighbours.size();k++)
+            {
+                if ((nTypes == 0) || (particles[neighbours[k]].type == j))
+                    verletParticles.push_back(neighbours[k]);
+            }
+        }
 
-                        // y loop for nearest neighbours
-                        for (b=0;b<3;b++)
-                        {
-                            y = (j+(b-1)+cellsPerAxis[1])%cellsPerAxis[1];
+        // Record the position at which the list was built.
+        for (unsigned int j=0;j<dimension;j++)
+            verletPositions[dimension*i + j] = position[j];
+    }
 
-                            // z loop for nearest neighbours
-                            for (c=0;c<3;c++)
-                            {
-                                z = (k+(c-1)+cellsPerAxis[2])%cellsPerAxis[2];
+    verletStart[particles.size()*nGroups] = verletParticles.size();
+}
 
-                                // nn cell index
-                                nn = x + y*cellsPerAxis[0] + z*cellsPerAxis[0]*cellsPerAxis[1];
+void CellList::rebuildNeighbourLists(std::vector<Particle>& particles)
+{
+    // Measure the number of updates per particle between rebuilds.
+    verletInterval = double(nUpdates) / particles.size();
+    nUpdates = 0;
+    isStale = false;
 
-                                at(m).neighbours[nnCount] = nn;
-                                nnCount++;
-                            }
-                        }
-                    }
+    // Re-evaluate the choice of strategy in light of the measured rebuild rate.
+    if (strategy == AUTOMATIC)
+    {
+        nParticles = particles.size();
+        selectStrategy();
 
-                    // zero tally for each cell
-                    at(m).tally = 0;
-                    at(m).index = m;
-                }
-            }
+        if (activeStrategy != VERLET)
+        {
+            buildGrid();
+            initCellList(particles);
+            return;
         }
     }
-    else
+
+    buildVerletLists(particles);
+}
+
+double CellList::computeSquaredDistance(const double* position1, const double* position2) const
+{
+    double normSqd = 0;
+
+    for (unsigned int i=0;i<dimension;i++)
     {
-        nNeighbours = 9;
+        double sep = position1[i] - position2[i];
 
-        // loop over all cells x direction
-        for (i=0;i<cellsPerAxis[0];i++)
+        // Enforce minimum image.
+        if (isPeriodic[i])
         {
-            // loop over all cells y direction
-            for (j=0;j<cellsPerAxis[1];j++)
-            {
-                // cell index
-                m = i + cellsPerAxis[0]*j;
-
-                // resize neighbour list and particle arrays
-                at(m).neighbours.resize(nNeighbours);
-                at(m).particles.resize(maxParticles);
+            if (sep < -0.5*boxSize[i]) sep += boxSize[i];
+            else if (sep >= 0.5*boxSize[i]) sep -= boxSize[i];
+        }
 
-                nnCount = 0;
+        normSqd += sep*sep;
+    }
 
-                // x loop for nearest neighbours
-                for (a=0;a<3;a++)
-                {
-                    x = (i+(a-1)+cellsPerAxis[0])%cellsPerAxis[0];
+    return normSqd;
+}
 
-                    // y loop for nearest neighbours
-                    for (b=0;b<3;b++)
-                    {
-                        y = (j+(b-1)+cellsPerAxis[1])%cellsPerAxis[1];
+void CellList::setGrid(const std::vector<double>& boxSize_, double range_, unsigned int subdivisions_)
+{
+    cellsPerAxis.resize(dimension);
+    cellSpacing.resize(dimension);
 
-                        // nn cell index
-                        nn = x + y*cellsPerAxis[0];
+    // minimum cell spacing
+    double minSpacing = range_ / subdivisions_;
 
-                        at(m).neighbours[nnCount] = nn;
-                        nnCount++;
-                    }
-                }
+    for (unsigned int i=0;i<dimension;i++)
+    {
+        cellsPerAxis[i] = 1;
 
-                // zero tally for each cell
-                at(m).tally = 0;
-                at(m).index = m;
-            }
+        while ((boxSize_[i] / (double) cellsPerAxis[i]) > minSpacing)
+        {
+            cellsPerAxis[i]++;
         }
+        cellsPerAxis[i]--;
+
+        // avoid division by zero for boxes smaller than a cell
+        if (cellsPerAxis[i] == 0) cellsPerAxis[i] = 1;
+
+        cellSpacing[i] = boxSize_[i] / (double) cellsPerAxis[i];
     }
 }
 
-void CellList::reset()
+bool CellList::isGridValid(unsigned int subdivisions_) const
 {
-    for (unsigned int i=0;i<nCells;i++) at(i).tally = 0;
+    // The stencil reaches subdivisions_ cells either side of each cell, so
+    // there must be enough cells that it doesn't wrap onto itself across
+    // periodic boundaries.
+    for (unsigned int i=0;i<dimension;i++)
+    {
+        if (isPeriodic[i] && (cellsPerAxis[i] < 2*subdivisions_ + 1)) return false;
+    }
+
+    return true;
 }
 
-int CellList::getCell(const Particle& particle)
+unsigned int CellList::computeStencil(double range_, unsigned int subdivisions_, std::vector<int>& offsets) const
 {
-    int cell,cellx,celly;
+    int extent = subdivisions_;
+    int width = 2*extent + 1;
 
-    cellx = int(particle.position[0]/cellSpacing[0]);
-    celly = int(particle.position[1]/cellSpacing[1]);
+    unsigned int nOffsets = 1;
+    for (unsigned int i=0;i<dimension;i++) nOffsets *= width;
 
-    cell = cellx + celly*cellsPerAxis[0];
+    std::vector<int> offset(dimension);
 
-    if (dimension == 3)
+    offsets.clear();
+
+    // Loop over all offsets in the (2*extent + 1)^dimension block, with the
+    // first axis varying slowest, so that the stencil is ordered lexicographically.
+    for (unsigned int n=0;n<nOffsets;n++)
     {
-        int cellz = int(particle.position[2]/cellSpacing[2]);
-        cell += cellz*cellsPerAxis[0]*cellsPerAxis[1];
+        unsigned int l = n;
+        double minDistSqd = 0;
+
+        for (int i=dimension-1;i>=0;i--)
+        {
+            offset[i] = int(l % width) - extent;
+            l /= width;
+
+            // closest approach of the two cells along this axis
+            int gap = std::abs(offset[i]) - 1;
+            if (gap > 0) minDistSqd += gap*gap*cellSpacing[i]*cellSpacing[i];
+        }
+
+        // Skip cells that lie entirely beyond the cut-off. (A small tolerance
+        // guards against rounding when assigning particles to cells.)
+        if (minDistSqd < range_*range_*(1 + 1e-10))
+        {
+            for (unsigned int i=0;i<dimension;i++)
+                offsets.push_back(offset[i]);
+        }
     }
 
-    return cell;
+    return offsets.size() / dimension;
 }
 
-void CellList::initCell(int newCell, Particle& particle)
+void CellList::setMask(const std::function<double (const double*)>& signedDistance, const double* reserved)
 {
-    // Add to new list
-    at(newCell).particles[at(newCell).tally] = particle.index;
-    particle.cell = newCell;
-    particle.posCell = at(newCell).tally;
-    at(newCell).tally++;
+    mask = signedDistance;
+
+    if (reserved != nullptr) reservedPoint.assign(reserved, reserved + dimension);
+    else reservedPoint.clear();
+
+    classifyCells();
+    allocateCells();
+    buildStencils();
+}
+
+void CellList::classifyCells()
+{
+    std::vector<double> centre(dimension);
 
-    if (at(newCell).tally == maxParticles && particle.cell !=0 )
+    // Half the diagonal of a cell.
+    double halfDiagonal = 0;
+    for (unsigned int i=0;i<dimension;i++) halfDiagonal += cellSpacing[i]*cellSpacing[i];
+    halfDiagonal = 0.5*sqrt(halfDiagonal);
+
+    for (unsigned int m=0;m<nCells;m++)
     {
-        std::cerr << "[ERROR] CellList: Maximum number of particles per cell exceeded!\n";
-        exit(EXIT_FAILURE);
+        // cell centre from cell index
+        unsigned int n = m;
+        for (unsigned int i=0;i<dimension;i++)
+        {
+            centre[i] = ((n % cellsPerAxis[i]) + 0.5)*cellSpacing[i];
+            n /= cellsPerAxis[i];
+        }
+
+        double distance = mask(&centre[0]);
+
+        // Every point in the cell lies within half a diagonal of its centre.
+        if (distance < -halfDiagonal) region[m] = INSIDE;
+        else if (distance > halfDiagonal) region[m] = OUTSIDE;
+        else region[m] = BOUNDARY;
+    }
+
+    // Keep storage for the reserved cell. It is classified as a boundary cell,
+    // so points within it are still tested exactly against the region.
+    if (!reservedPoint.empty())
+    {
+        Particle particle;
+        particle.position = reservedPoint;
+
+        unsigned int cell = getCell(particle);
+        if (region[cell] == OUTSIDE) region[cell] = BOUNDARY;
     }
 }
 
-void CellList::initCellList(std::vector<Particle>& particles)
+int CellList::getRegion(const double* position) const
 {
-    for (unsigned int i=0;i<particles.size();i++)
+    unsigned int cell = 0;
+    unsigned int stride = 1;
+
+    for (unsigned int i=0;i<dimension;i++)
     {
-        initCell(getCell(particles[i]), particles[i]);
+        int x = int(floor(position[i]/cellSpacing[i]));
+
+        if (isPeriodic[i])
+        {
+            x %= (int) cellsPerAxis[i];
+            if (x < 0) x += cellsPerAxis[i];
+        }
+        else
+        {
+            if (position[i] < 0) return OUTSIDE;
+            if (x >= (int) cellsPerAxis[i])
+            {
+                if (position[i] > cellsPerAxis[i]*cellSpacing[i]) return OUTSIDE;
+                x = cellsPerAxis[i] - 1;
+            }
+        }
+
+        cell += stride*x;
+        stride *= cellsPerAxis[i];
     }
+
+    return region[cell];
 }
 
-void CellList::updateCell(int newCell, Particle& particle, std::vector<Particle>& particles)
+void CellList::allocateCells()
 {
-    // Remove from old list
-    at(particle.cell).tally--;
-    at(particle.cell).particles[particle.posCell] = at(particle.cell).particles[at(particle.cell).tally];
-    particles[at(particle.cell).particles[at(particle.cell).tally]].posCell = particle.posCell;
-
-    // Add to new list
-    at(newCell).particles[at(newCell).tally] = particle.index;
-    particle.cell = newCell;
-    particle.posCell = at(newCell).tally;
-    at(newCell).tally++;
+    // Only cells that aren't masked need storage.
+    blockIndex.assign(nCells, 0);
+    nBlocks = 0;
 
-    if (at(newCell).tally == maxParticles)
+    for (unsigned int m=0;m<nCells;m++)
     {
-        std::cerr << "[ERROR] CellList: Maximum number of particles per cell exceeded!\n";
-        exit(EXIT_FAILURE);
+        if (region[m] != OUTSIDE)
+        {
+            blockIndex[m] = nBlocks;
+            nBlocks++;
+        }
     }
+
+    tally.assign(nCells, 0);
+    cellParticles.assign(nBlocks*maxParticles, 0);
+    typeTally.assign(nCells*nTypes, 0);
+    typeParticles.assign(nBlocks*nTypes*maxParticles, 0);
 }
 
-void CellList::setDimension(unsigned int dimension_)
+void CellList::buildStencils()
 {
-    dimension = dimension_;
+    unsigned int nNeighbours = stencilOffsets.size() / dimension;
+
+    neighbourStart.resize(nCells + 1);
+    neighbourCells.clear();
+    neighbourCells.reserve(nCells*nNeighbours);
+    halfNeighbourStart.resize(nCells + 1);
+    halfNeighbourCells.clear();
+    halfNeighbourCells.reserve(nCells*((nNeighbours + 1)/2));
+
+    // cell coordinates
+    std::vector<int> cellCoord(dimension);
+
+    // The last cell whose stencil included each cell. On small periodic grids
+    // the stencil can wrap onto itself, so each neighbour is only added once.
+    std::vector<unsigned int> lastVisit(nCells, nCells);
+
+    // loop over all cells
+    for (unsigned int m=0;m<nCells;m++)
+    {
+        neighbourStart[m] = neighbourCells.size();
+        halfNeighbourStart[m] = halfNeighbourCells.size();
+
+        // masked cells have no neighbours
+        if (region[m] == OUTSIDE) continue;
+
+        // The half-shell stencil starts with the cell itself.
+        halfNeighbourCells.push_back(m);
+
+        // cell coordinates from cell index
+        unsigned int n = m;
+        for (unsigned int i=0;i<dimension;i++)
+        {
+            cellCoord[i] = n % cellsPerAxis[i];
+            n /= cellsPerAxis[i];
+        }
+
+        // loop over stencil
+        for (unsigned int j=0;j<nNeighbours;j++)
+        {
+            // nn cell index
+            unsigned int nn = 0;
+            unsigned int stride = 1;
+            bool isInside = true;
+
+            for (unsigned int i=0;i<dimension;i++)
+            {
+                int x = cellCoord[i] + stencilOffsets[dimension*j + i];
+
+                // don't wrap across non-periodic boundaries
+                if (!isPeriodic[i] && ((x < 0) || (x >= (int) cellsPerAxis[i])))
+                {
+                    isInside = false;
+                    break;
+                }
+
+                nn += stride*((x + cellsPerAxis[i]) % cellsPerAxis[i]);
+                stride *= cellsPerAxis[i];
+            }
+
+            // skip masked and repeated cells
+            if (isInside && (region[nn] != OUTSIDE) && (lastVisit[nn] != m))
+            {
+                lastVisit[nn] = m;
+                neighbourCells.push_back(nn);
+
+                // The full stencil is symmetric, so taking the neighbours with
+                // a larger index counts each pair of cells exactly once.
+                if (nn > m) halfNeighbourCells.push_back(nn);
+            }
+        }
+    }
+
+    neighbourStart[nCells] = neighbourCells.size();
+    halfNeighbourStart[nCells] = halfNeighbourCells.size();
 }
 
-unsigned int CellList::getNeighbours() const
+void CellList::resizeCells(unsigned int maxParticles_)
 {
-    return nNeighbours;
+    std::vector<unsigned int> newParticles(nBlocks*maxParticles_);
+
+    // copy each block into its new, larger, slot
+    for (unsigned int i=0;i<nCells;i++)
+    {
+        unsigned int block = blockIndex[i];
+
+        for (unsigned int j=0;j<tally[i];j++)
+            newParticles[block*maxParticles_ + j] = cellParticles[block*maxParticles + j];
+    }
+
+    cellParticles.swap(newParticles);
+
+    // and the same for the per-type blocks
+    if (nTypes > 0)
+    {
+        std::vector<unsigned int> newTypeParticles(nBlocks*nTypes*maxParticles_);
+
+        for (unsigned int i=0;i<nCells;i++)
+        {
+            for (unsigned int k=0;k<nTypes;k++)
+            {
+                unsigned int block = blockIndex[i]*nTypes + k;
+
+                for (unsigned int j=0;j<typeTally[i*nTypes + k];j++)
+                    newTypeParticles[block*maxParticles_ + j] = typeParticles[block*maxParticles + j];
+            }
+        }
+
+        typeParticles.swap(newTypeParticles);
+    }
+
+    maxParticles = maxParticles_;
 }
@@ -18,42 +18,74 @@
 #ifndef _CELLLIST_H
 #define _CELLLIST_H
 
+#include <functional>
 #include <vector>
 
+#include "Particle.h"
+
 /*! \file CellList.h
     \brief An efficient, dynamically updated cell list implementation for
     calculating finite ranged pair interactions.
 
-    For efficiency, the CellList class makes use of fixed size std::vector
-    data structures that are contiguous in memory, rather than the (potentially)
-    more flexible C++ std::list and std::undordered_set containers. Simple
-    bookkeeping tricks ensure that cell insertions and deletions are
-    O(1) complexity.
-
-    Since the vector containers are of fixed size it is important that they
-    are large enough to store enough particles. The typical cell occupancy is
-    estimated from the range of the pair interaction and overflows are checked
-    for at run time.
+    For efficiency, the CellList class stores all of its data in a handful of
+    flat std::vector containers that are contiguous in memory, rather than
+    the (potentially) more flexible C++ std::list and std::undordered_set
+    containers, or a separate heap allocation per cell. Particle indices are
+    stored in fixed size blocks, one per cell, within a single array, and cell
+    tallies live in their own array. The neighbour stencil of every cell is
+    stored once in compressed sparse row (CSR) format. Simple bookkeeping tricks
+    ensure that cell insertions and deletions are O(1) complexity.
+
+    Cells can optionally be a fraction, range/k, of the interaction range
+    (k = 2 or 3). Stencils then reach k cells in each direction, skipping any
+    cell that lies entirely beyond the cut-off, so that the search volume more
+    closely matches the cut-off sphere. When the number of particles is known
+    the number of subdivisions is chosen automatically from the density.
+
+    Optionally, the cell list can also keep a separate record of the particles
+    of each type within every cell, so that queries can skip particle types
+    that don't interact.
+
+    A second, half-shell, stencil (the cell itself plus 13 neighbours in 3D, or
+    4 in 2D) is used to enumerate every unordered pair of particles in nearby
+    cells exactly once, e.g. when computing the total energy of the system.
+
+    For confined geometries, a mask can be applied to the grid. Cells that lie
+    wholly outside of the confining region are dropped from storage and from
+    every stencil, and a cheap lookup classifies a point as being inside,
+    outside, or close to the boundary of the region.
+
+    Neighbour queries can use one of three strategies behind the same
+    interface: a brute-force search over every particle (a single cell),
+    cell lists, or Verlet lists, i.e. a per-particle list of the particles
+    within the interaction range plus a skin, which is rebuilt once any
+    particle has moved more than half of the skin. By default the strategy
+    with the lowest estimated query cost is chosen from the number of
+    particles, the box size, and the density. The choice is re-evaluated
+    whenever the cell list is initialised, and each time the Verlet lists
+    are rebuilt, using the measured rebuild rate. If the box is too small
+    for cells, a brute-force search is used.
+
+    Since the blocks are of fixed size it is important that they are large
+    enough to store enough particles. The typical cell occupancy is estimated
+    from the range of the pair interaction and overflows are checked for at
+    run time.
 */
 
-// FORWARD DECLARATIONS
-
-struct Particle;
-
-//! Structure containing attributes for an individual cell.
-struct Cell
-{
-    unsigned int index;                     //!< Cell index.
-    unsigned int tally;                     //!< Number of particles in the cell.
-    std::vector<unsigned int> particles;    //!< Indices of particles in the cell.
-    std::vector<unsigned int> neighbours;   //!< Indices of nearest neighbour cells.
-};
-
 //! Container class for storing a list of cells.
 //! This class contains the main cell list that is manipulated by the simulation.
-class CellList : public std::vector<Cell>
+class CellList
 {
 public:
+    //! Classification of a cell with respect to a mask.
+    enum Region { INSIDE, BOUNDARY, OUTSIDE };
+
+    //! Neighbour search strategy.
+    enum Strategy { AUTOMATIC, BRUTE_FORCE, CELLS, VERLET };
+
+    /// Maximum number of cells per interaction range.
+    static const unsigned int MAX_SUBDIVISIONS = 3;
+
     //! Default constructor.
     CellList();
 
@@ -69,20 +101,21 @@ public:
      */
     CellList(unsigned int, const std::vector<double>&, double);
 
-    //! Copy constructor. \param cells A reference to an existing CellList object.
-    CellList& operator = (const CellList&);
-
-    //! Copy constructor. \param cells A vector of existing Cell data structures.
-    CellList& operator = (const std::vector<Cell>&);
-
     //! Initialise cell lists.
     /*! \param boxSize
             The size of the simulation box in each dimension.
 
         \param range
             Maximum interaction range.
+
+        \param nParticles
+            The number of particles, used to choose the strategy and cell size
+            automatically (zero for cells of the interaction range).
+
+        \param subdivisions
+            The number of cells per interaction range (zero to choose automatically).
      */
-    void initialise(const std::vector<double>&, double);
+    void initialise(const std::vector<double>&, double, unsigned int nParticles = 0, unsigned int subdivisions = 0);
 
     //! Reset cell lists (zero cell tallys).
     void reset();
@@ -106,10 +139,20 @@ public:
     void initCell(int, Particle&);
 
     //! Initialise cell list for all particles.
-    /*! \param particles Reference to a vector of particles.
+    /*! The cell list is rebuilt from scratch with a counting sort, which is
+        multithreaded when compiled with OpenMP. Within each cell, particles
+        are stored in index order.
+
+        \param particles Reference to a vector of particles.
      */
     void initCellList(std::vector<Particle>&);
 
+    //! Initialise any per-particle neighbour lists, e.g. after initialising
+    //! the cell list particle by particle with initCell.
+    /*! \param particles Reference to a vector of particles.
+     */
+    void initNeighbourLists(std::vector<Particle>&);
+
     //! Update cell list for an individual particle.
     /*! \param newCell
             The index of the cell in which the particle is located.
@@ -122,22 +165,531 @@ public:
      */
     void updateCell(int, Particle&, std::vector<Particle>&);
 
+    //! Update the neighbour search following a particle move.
+    /*! This updates the cell list and, if the particle has moved more than
+        half of the skin, marks the Verlet lists for a rebuild.
+
+        \param particle
+            Reference to a particle.
+
+        \param particles
+            Reference to a vector of particles.
+     */
+    void updateParticle(Particle&, std::vector<Particle>&);
+
+    //! Rebuild the Verlet lists if they were marked as stale by a particle update.
+    /*! Call before a neighbour query. Rebuilds are deferred until then so that
+        the lists are rebuilt at most once per move, however many particles move.
+
+        \param particles
+            Reference to a vector of particles.
+     */
+    void refreshNeighbourLists(std::vector<Particle>&);
+
+    //! Rescale the cell list following a change in box size.
+    /*! The cell spacing is rescaled in place, so only particles that change
+        cell are moved. The grid is rebuilt if the cells become smaller than
+        the cut-off, or large enough to fit in another cell.
+
+        \param boxSize_
+            The new size of the simulation box.
+
+        \param particles
+            Reference to a vector of particles.
+     */
+    void rescale(const std::vector<double>&, std::vector<Particle>&);
+
     //! Set the dimensionality of the cell list.
     /*! \param dimension_
             The dimensionality of the simulation.
      */
     void setDimension(unsigned int);
 
-    //! Get the number of neighbours per cell.
-    unsigned int getNeighbours() const;
+    //! Set the periodicity of the cell list.
+    /*! Stencils don't wrap across non-periodic boundaries. Call this before
+        initialise (the default is a fully periodic box).
+
+        \param isPeriodic_
+            Whether the box is periodic along each axis.
+     */
+    void setPeriodicity(const std::vector<bool>&);
+
+    //! Keep a separate record of the particles of each type within every cell.
+    /*! This resets the cell list, which must then be rebuilt, e.g. with initCellList.
+
+        \param nTypes_
+            The number of particle types (zero to disable per-type occupancy).
+     */
+    void setTypes(unsigned int);
+
+    //! Mask the cell list with a confining region.
+    /*! Cells that lie wholly outside of the region are removed from storage and
+        from all stencils. This resets the cell list, which must then be rebuilt,
+        e.g. with initCellList. Call this after initialise.
+
+        \param signedDistance
+            A function returning the signed distance of a point from the surface
+            of the region (negative inside).
+
+        \param reserved
+            A point whose cell keeps its storage even if it lies outside of the
+            region, e.g. where inactive particles are parked (may be null).
+     */
+    void setMask(const std::function<double (const double*)>&, const double* reserved = nullptr);
+
+    //! Classify a point with respect to the mask.
+    /*! \param position
+            The coordinates of the point.
+
+        \return
+            INSIDE if the point lies in a cell wholly inside of the region,
+            OUTSIDE if it lies in a cell wholly outside (or outside of a
+            non-periodic box), and BOUNDARY otherwise.
+     */
+    int getRegion(const double*) const;
+
+    //! Set the neighbour search strategy (call before initialise).
+    /*! \param strategy_
+            The strategy (AUTOMATIC to choose from the estimated query cost).
+     */
+    void setStrategy(Strategy);
+
+    //! Get the neighbour search strategy in use.
+    Strategy getStrategy() const;
+
+    //! Set the Verlet list skin (call before initialise).
+    /*! \param verletSkin_
+            The distance beyond the interaction range within which particles are listed.
+     */
+    void setVerletSkin(double);
+
+    //! Get the number of particle types with per-type occupancy.
+    unsigned int getTypes() const;
+
+    //! Get the number of cells per interaction range.
+    unsigned int getSubdivisions() const;
+
+    //! Get the total number of cells.
+    unsigned int size() const;
+
+    //! Get the number of neighbours of a cell (including the cell itself).
+    /*! \param cell
+            The cell index.
+
+        \return
+            The number of neighbouring cells.
+     */
+    unsigned int getNeighbours(unsigned int) const;
+
+    //! Get the indices of the neighbours of a cell (including the cell itself).
+    /*! \param cell
+            The cell index.
+
+        \return
+            A pointer to the neighbouring cell indices.
+     */
+    const unsigned int* getNeighbourCells(unsigned int) const;
+
+    //! Get the number of blocks of candidate neighbours of a particle.
+    //! These are the neighbouring cells, or the particle's Verlet list.
+    /*! \param particle
+            Reference to a particle.
+
+        \return
+            The number of blocks.
+     */
+    unsigned int getNeighbourBlocks(const Particle&) const;
+
+    //! Get a block of candidate neighbours of a particle (may include the particle itself).
+    /*! \param particle
+            Reference to a particle.
+
+        \param block
+            The block index.
+
+        \param blockParticles
+            A pointer to the particle indices (output).
+
+        \return
+            The number of particles in the block.
+     */
+    unsigned int getNeighbourBlock(const Particle&, unsigned int, const unsigned int*&) const;
+
+    //! Get a block of candidate neighbours of a given type (requires per-type occupancy).
+    /*! \param particle
+            Reference to a particle.
+
+        \param block
+            The block index.
+
+        \param type
+            The particle type.
+
+        \param blockParticles
+            A pointer to the particle indices (output).
+
+        \return
+            The number of particles of the given type in the block.
+     */
+    unsigned int getNeighbourBlock(const Particle&, unsigned int, unsigned int, const unsigned int*&) const;
+
+    //! Get the number of particles in a cell.
+    /*! \param cell
+            The cell index.
+
+        \return
+            The number of particles in the cell.
+     */
+    unsigned int getTally(unsigned int) const;
+
+    //! Get the indices of the particles in a cell.
+    /*! \param cell
+            The cell index.
+
+        \return
+            A pointer to the particle indices.
+     */
+    const unsigned int* getParticles(unsigned int) const;
+
+    //! Get the number of particles of a given type in a cell (requires per-type occupancy).
+    /*! \param cell
+            The cell index.
+
+        \param type
+            The particle type.
+
+        \return
+            The number of particles of the given type in the cell.
+     */
+    unsigned int getTally(unsigned int, unsigned int) const;
+
+    //! Get the indices of the particles of a given type in a cell (requires per-type occupancy).
+    /*! \param cell
+            The cell index.
+
+        \param type
+            The particle type.
+
+        \return
+            A pointer to the particle indices.
+     */
+    const unsigned int* getParticles(unsigned int, unsigned int) const;
+
+    //! Get the number of cells in the half-shell stencil of a cell (including the cell itself).
+    /*! \param cell
+            The cell index.
+
+        \return
+            The number of cells in the half-shell stencil.
+     */
+    unsigned int getHalfNeighbours(unsigned int) const;
+
+    //! Get the indices of the cells in the half-shell stencil of a cell.
+    //! The first entry is always the cell itself.
+    /*! \param cell
+            The cell index.
+
+        \return
+            A pointer to the half-shell cell indices.
+     */
+    const unsigned int* getHalfNeighbourCells(unsigned int) const;
+
+    //! Visit every unordered pair of particles in neighbouring cells exactly once.
+    /*! \param pairFunction
+            A function object called as pairFunction(particle1, particle2) for
+            each pair. Enumeration stops early if it returns true.
+
+        \return
+            Whether the enumeration was stopped early.
+     */
+    template <typename PairFunction>
+    bool forEachPair(PairFunction) const;
 
 private:
     unsigned int dimension;                     //!< Dimension of the simulation box.
     unsigned int nCells;                        //!< Total number of cells.
-    unsigned int nNeighbours;                   //!< Number of neighbours per cell.
-    unsigned int maxParticles;                  //!< Maximum number of particles per cell.
+    unsigned int nBlocks;                       //!< Number of cells with storage (those that aren't masked).
+    unsigned int maxParticles;                  //!< Maximum number of particles per cell (block size).
+    unsigned int subdivisions;                  //!< Number of cells per interaction range.
     std::vector<unsigned int> cellsPerAxis;     //!< Number of cells per axis.
+    std::vector<bool> isPeriodic;               //!< Whether the box is periodic along each axis.
     std::vector<double> cellSpacing;            //!< Spacing between cells.
+    std::vector<int> stencilOffsets;            //!< Stencil offsets (dimension entries per cell).
+    std::vector<char> region;                   //!< Classification of each cell with respect to the mask.
+    std::vector<unsigned int> blockIndex;       //!< Index of each cell's storage block.
+
+    std::vector<unsigned int> tally;            //!< Number of particles in each cell.
+    std::vector<unsigned int> cellParticles;    //!< Indices of particles in each cell (fixed size block per cell).
+    unsigned int nTypes;                        //!< Number of particle types with per-type occupancy (zero if disabled).
+    std::vector<unsigned int> typeTally;        //!< Number of particles of each type in each cell.
+    std::vector<unsigned int> typeParticles;    //!< Indices of particles of each type in each cell (fixed size block per cell and type).
+    std::vector<unsigned int> posType;          //!< Position of each particle in its per-type block.
+    std::vector<unsigned int> neighbourStart;   //!< Offset of each cell's stencil in neighbourCells (CSR).
+    std::vector<unsigned int> neighbourCells;   //!< Indices of nearest neighbour cells for all cells (CSR).
+    std::vector<unsigned int> halfNeighbourStart;   //!< Offset of each cell's half-shell stencil in halfNeighbourCells (CSR).
+    std::vector<unsigned int> halfNeighbourCells;   //!< Indices of half-shell neighbour cells for all cells (CSR).
+    std::function<double (const double*)> mask;     //!< Signed distance from the surface of the masking region (if any).
+    std::vector<double> reservedPoint;              //!< A point whose cell is never masked (empty if none).
+
+    Strategy strategy;                          //!< The requested neighbour search strategy.
+    Strategy activeStrategy;                    //!< The neighbour search strategy in use.
+    double verletSkin;                          //!< Distance beyond the interaction range within which particles are listed.
+    double verletInterval;                      //!< Estimated number of updates per particle between Verlet list rebuilds.
+    unsigned long nUpdates;                     //!< Number of particle updates since the Verlet lists were rebuilt.
+    bool isStale;                               //!< Whether the Verlet lists must be rebuilt before the next query.
+    double range;                               //!< Maximum interaction range.
+    unsigned int nParticles;                    //!< Number of particles (zero if unknown).
+    unsigned int requestedSubdivisions;         //!< Requested number of cells per interaction range (zero for automatic).
+    std::vector<double> boxSize;                //!< Size of the simulation box.
+    std::vector<unsigned int> verletStart;      //!< Offset of each particle's Verlet list (per type group) in verletParticles (CSR).
+    std::vector<unsigned int> verletParticles;  //!< Indices of the particles in each Verlet list (CSR).
+    std::vector<double> verletPositions;        //!< Position of each particle when the Verlet lists were built.
+
+    //! Set the number of cells and their spacing along each axis.
+    /*! \param boxSize
+            The size of the simulation box in each dimension.
+
+        \param range
+            Maximum interaction range.
+
+        \param subdivisions_
+            The number of cells per interaction range.
+     */
+    void setGrid(const std::vector<double>&, double, unsigned int);
+
+    //! Check that the stencil doesn't wrap onto itself for the current grid.
+    /*! \param subdivisions_
+            The number of cells per interaction range.
+
+        \return
+            Whether there are enough cells along each axis.
+     */
+    bool isGridValid(unsigned int) const;
+
+    //! Compute the stencil offsets for the current grid.
+    /*! \param range
+            Maximum interaction range.
+
+        \param subdivisions_
+            The number of cells per interaction range.
+
+        \param offsets
+            The cell offsets (dimension entries per cell), in lexicographic order.
+
+        \return
+            The number of cells in the stencil (including the cell itself).
+     */
+    unsigned int computeStencil(double, unsigned int, std::vector<int>&) const;
+
+    //! Choose the neighbour search strategy and number of subdivisions.
+    void selectStrategy();
+
+    //! Estimate the cost of a cell list query, relative to that of testing a pair.
+    /*! This overwrites the current grid.
+
+        \param searchRange
+            The range of the query.
+
+        \param subdivisions_
+            The number of cells per range.
+
+        \param density
+            The number density of particles.
+
+        \return
+            The estimated cost.
+     */
+    double estimateCellCost(double, unsigned int, double);
+
+    //! Estimate the cost of a Verlet list query, including amortised rebuilds.
+    /*! This overwrites the current grid.
+
+        \param density
+            The number density of particles.
+
+        \return
+            The estimated cost.
+     */
+    double estimateVerletCost(double);
+
+    //! Build the grid, storage, and stencils for the current strategy.
+    void buildGrid();
+
+    //! Classify every cell with respect to the mask.
+    void classifyCells();
+
+    //! Build the Verlet list of every particle from the cell list.
+    /*! \param particles
+            Reference to a vector of particles.
+     */
+    void buildVerletLists(const std::vector<Particle>&);
+
+    //! Rebuild the Verlet lists, re-evaluating the choice of strategy.
+    /*! \param particles
+            Reference to a vector of particles.
+     */
+    void rebuildNeighbourLists(std::vector<Particle>&);
+
+    //! Compute the squared minimum image distance between two points.
+    /*! \param position1
+            The coordinates of the first point.
+
+        \param position2
+            The coordinates of the second point.
+
+        \return
+            The squared distance.
+     */
+    double computeSquaredDistance(const double*, const double*) const;
+
+    //! Allocate storage for every cell that isn't masked.
+    void allocateCells();
+
+    //! Build the full and half-shell stencils of every cell that isn't masked.
+    void buildStencils();
+
+    //! Increase the block size for each cell, preserving the current cell occupancy.
+    /*! \param maxParticles_
+            The new maximum number of particles per cell.
+     */
+    void resizeCells(unsigned int);
+
+    /// Estimated cost of visiting a cell, relative to that of testing a pair.
+    static constexpr double CELL_COST = 1.0;
+
+    /// Estimated number of neighbour queries per particle update.
+    static constexpr double QUERIES_PER_UPDATE = 2.0;
+
+    /// Initial estimate of the number of updates per particle between Verlet list rebuilds.
+    static constexpr double VERLET_INTERVAL = 1.0;
 };
 
+inline unsigned int CellList::size() const
+{
+    return nCells;
+}
+
+inline unsigned int CellList::getNeighbours(unsigned int cell) const
+{
+    return neighbourStart[cell+1] - neighbourStart[cell];
+}
+
+inline const unsigned int* CellList::getNeighbourCells(unsigned int cell) const
+{
+    return &neighbourCells[neighbourStart[cell]];
+}
+
+inline void CellList::refreshNeighbourLists(std::vector<Particle>& particles)
+{
+    if (isStale) rebuildNeighbourLists(particles);
+}
+
+inline unsigned int CellList::getNeighbourBlocks(const Particle& particle) const
+{
+    if (activeStrategy == VERLET) return 1;
+    else return getNeighbours(particle.cell);
+}
+
+inline unsigned int CellList::getNeighbourBlock(const Particle& particle,
+    unsigned int block, const unsigned int*& blockParticles) const
+{
+    if (activeStrategy == VERLET)
+    {
+        unsigned int nGroups = (nTypes > 0) ? nTypes : 1;
+        unsigned int start = verletStart[particle.index*nGroups];
+
+        blockParticles = verletParticles.data() + start;
+        return verletStart[(particle.index + 1)*nGroups] - start;
+    }
+    else
+    {
+        unsigned int cell = getNeighbourCells(particle.cell)[block];
+
+        blockParticles = getParticles(cell);
+        return tally[cell];
+    }
+}
+
+inline unsigned int CellList::getNeighbourBlock(const Particle& particle,
+    unsigned int block, unsigned int type, const unsigned int*& blockParticles) const
+{
+    if (activeStrategy == VERLET)
+    {
+        unsigned int start = verletStart[particle.index*nTypes + type];
+
+        blockParticles = verletParticles.data() + start;
+        return verletStart[particle.index*nTypes + type + 1] - start;
+    }
+    else
+    {
+        unsigned int cell = getNeighbourCells(particle.cell)[block];
+
+        blockParticles = getParticles(cell, type);
+        return getTally(cell, type);
+    }
+}
+
+inline unsigned int CellList::getTally(unsigned int cell) const
+{
+    return tally[cell];
+}
+
+inline const unsigned int* CellList::getParticles(unsigned int cell) const
+{
+    return &cellParticles[blockIndex[cell]*maxParticles];
+}
+
+inline unsigned int CellList::getTally(unsigned int cell, unsigned int type) const
+{
+    return typeTally[cell*nTypes + type];
+}
+
+inline const unsigned int* CellList::getParticles(unsigned int cell, unsigned int type) const
+{
+    return &typeParticles[(blockIndex[cell]*nTypes + type)*maxParticles];
+}
+
+inline unsigned int CellList::getHalfNeighbours(unsigned int cell) const
+{
+    return halfNeighbourStart[cell+1] - halfNeighbourStart[cell];
+}
+
+inline const unsigned int* CellList::getHalfNeighbourCells(unsigned int cell) const
+{
+    return &halfNeighbourCells[halfNeighbourStart[cell]];
+}
+
+template <typename PairFunction>
+bool CellList::forEachPair(PairFunction pairFunction) const
+{
+    for (unsigned int i=0;i<nCells;i++)
+    {
+        const unsigned int* particles1 = getParticles(i);
+        const unsigned int* stencil = getHalfNeighbourCells(i);
+        unsigned int nStencil = getHalfNeighbours(i);
+
+        for (unsigned int j=0;j<tally[i];j++)
+        {
+            // Pairs within the same cell.
+            for (unsigned int k=j+1;k<tally[i];k++)
+            {
+                if (pairFunction(particles1[j], particles1[k])) return true;
+            }
+
+            // Pairs with the forward half of the neighbouring cells.
+            for (unsigned int k=1;k<nStencil;k++)
+            {
+                const unsigned int* particles2 = getParticles(stencil[k]);
+
+                for (unsigned int l=0;l<tally[stencil[k]];l++)
+                {
+                    if (pairFunction(particles1[j], particles2[l])) return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
 #endif  /* _CELLLIST_H */
@@ -21,6 +21,7 @@
 #include "Particle.h"
 #include "CellList.h"
 #include "CosSquared.h"
+#include "Simd.h"
 
 CosSquared::CosSquared(
     Box& box_,
@@ -29,35 +30,24 @@ CosSquared::CosSquared(
     unsigned int maxInteractions_,
     double interactionEnergy_,
     double interactionRange_) :
-    Model(box_, particles_, cells_, maxInteractions_, interactionEnergy_, interactionRange_)
+    StaticModel<CosSquared>(box_, particles_, cells_, maxInteractions_, interactionEnergy_, interactionRange_)
 {
 }
 
 #ifndef ISOTROPIC
-double CosSquared::computePairEnergy(const unsigned int particle1, const double* position1, const unsigned int type1,
-    const double* orientation1, const unsigned int particle2, const double* position2,const unsigned int type2, const double* orientation2)
+double CosSquared::computePairEnergyFromDistance(unsigned int particle1, const double* position1, unsigned int type1,
+    const double* orientation1, unsigned int particle2, const double* position2, unsigned int type2,
+    const double* orientation2, double normSqd)
 #else
-double CosSquared::computePairEnergy(const unsigned int particle1,
-    const double* position1, const unsigned int type1, const unsigned int particle2, const double* position2, const unsigned int type2)
+double CosSquared::computePairEnergyFromDistance(unsigned int particle1, const double* position1, unsigned int type1,
+    unsigned int particle2, const double* position2, unsigned int type2, double normSqd)
 #endif
-        
 {
-    // Separation vector.
-    std::vector<double> sep(box.dimension);
-
-    // Calculate separation.
-    for (unsigned int i=0;i<box.dimension;i++)
-        sep[i] = position1[i] - position2[i];
-
-    // Enforce minimum image.
-    box.minimumImage(sep);
-
-    double normSqd = 0;
-
-    // Calculate squared norm of vector.
-    for (unsigned int i=0;i<box.dimension;i++)
-        normSqd += sep[i]*sep[i];
+    return computeRadialEnergy(normSqd, type1, type2);
+}
 
+double CosSquared::computeRadialEnergy(double normSqd, unsigned int type1, unsigned int type2) const
+{
     // Particles interact.
     
     if (normSqd < 1 && type1!=0 && type2!=0 )
@@ -93,3 +83,51 @@ double CosSquared::computePairEnergy(const unsigned int particle1,
     
     else return 0;
 }
+
+#ifndef ISOTROPIC
+void CosSquared::computeBatchEnergies(unsigned int particle, const double* position, unsigned int type,
+    const double* orientation, NeighbourBatch& batch)
+#else
+void CosSquared::computeBatchEnergies(unsigned int particle, const double* position, unsigned int type,
+    NeighbourBatch& batch)
+#endif
+{
+    const double* inverseBoxSize = &box.getInverseBoxSize()[0];
+
+    simd::Double zero = simd::set(0);
+    simd::Double one = simd::set(1.0);
+    simd::Double two = simd::set(2.0);
+    simd::Double epsilon = simd::set(interactionEnergy);
+    simd::Double cutOff = simd::set(squaredCutOffDistance);
+    simd::Double phase = simd::set(M_PI/(2*(interactionRange-1)));
+
+    // The core only acts between non-zero types, the well only between type 1 particles.
+    bool isCore = (type != 0);
+    bool isWell = (type == 1);
+
+    // Process whole vectors (the batch capacity is padded to the SIMD width).
+    for (unsigned int i=0;i<batch.size;i+=simd::WIDTH)
+    {
+        simd::Double normSqd = simd::squaredDistance(position, &batch.coordinates[0],
+            batch.capacity, i, &box.boxSize[0], inverseBoxSize, box.dimension);
+
+        simd::Double types = simd::load(&batch.types[i]);
+
+        // Repulsive core.
+        simd::Double r2Inv = one / normSqd;
+        simd::Double r6Inv = r2Inv*r2Inv*r2Inv;
+        simd::Double core = epsilon*((r6Inv*r6Inv) - two*r6Inv + one);
+        core = simd::select(types == zero, zero, core);
+
+        // Attractive well (the argument lies in [0, pi/2) for separations in range).
+        simd::Double cosine = simd::cos((simd::sqrt(normSqd) - one)*phase);
+        simd::Double attraction = zero - epsilon*cosine*cosine;
+        attraction = simd::select(types == one, attraction, zero);
+
+        simd::Double energy = simd::select(normSqd < cutOff, isWell ? attraction : zero, zero);
+        energy = simd::select(normSqd < one, isCore ? core : zero, energy);
+
+        simd::store(&batch.energies[i], energy);
+        simd::store(&batch.squaredDistances[i], normSqd);
+    }
+}
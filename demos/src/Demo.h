@@ -1,6 +1,9 @@
 #ifndef _DEMO_H
 #define _DEMO_H
 
+#include "Autotuner.h"
+#include "BondedModel.h"
+#include "Bonds.h"
 #include "Box.h"
 #include "CellList.h"
 #include "CosSquared.h"
@@ -8,10 +11,14 @@
 #include "InputOutput.h"
 #include "LennardJonesium.h"
 #include "Model.h"
+#include "MultiSpeciesModel.h"
 #include "Particle.h"
 #include "PatchyDisc.h"
+#include "Simd.h"
 #include "SingleParticleMove.h"
 #include "SquareWellium.h"
 #include "SquareWelliumWall.h"
+#include "StaticModel.h"
+#include "TabulatedModel.h"
 
 #endif
@@ -15,7 +15,9 @@
   along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cmath>
 #include <cstdlib>
+#include <functional>
 #include <iostream>
 
 #include "Box.h"
@@ -24,7 +26,7 @@
 #include "Initialise.h"
 #include "MersenneTwister.h"
 
-Initialise::Initialise()
+Initialise::Initialise() : cells(nullptr)
 {
 }
 
@@ -53,6 +55,7 @@ void Initialise::random(std::vector<Particle>& particles, CellList& cells, Box&
 
         // Set particle index.
         particles[i].index = i;
+        particles[i].id = i;
         particles[i].type = 1;
 
         // Keep trying to insert particle until there is no overlap.
@@ -133,6 +136,7 @@ void Initialise::random(std::vector<Particle>& particles, CellList& cells, Box&
 
         // Set particle index.
         particles[i].index = i;
+        particles[i].id = i;
         particles[i].type = 0;
 
         // Keep trying to insert particle until there is no overlap.
@@ -142,7 +146,7 @@ void Initialise::random(std::vector<Particle>& particles, CellList& cells, Box&
 
             // Generate a random position.
             for (unsigned int j=0;j<box.dimension;j++)
-                vec[j] = 2; //rng()*box.boxSize[j];
+                vec[j] = PARK_POSITION; //rng()*box.boxSize[j];
 
             particles[i].position = vec;
 
@@ -182,7 +186,9 @@ void Initialise::random(std::vector<Particle>& particles, CellList& cells, Box&
         // Update cell list.
         cells.initCell(particles[i].cell, particles[i]);
     }
-    
+
+    // Build any neighbour lists now that the configuration is complete.
+    cells.initNeighbourLists(particles);
 }
 
 #ifndef ISOTROPIC
@@ -191,11 +197,21 @@ bool Initialise::outsideSpherocylinder(unsigned int particle, const double* posi
 bool Initialise::outsideSpherocylinder(unsigned int particle, const double* position)
 #endif
 {
+    // Use the cell classification, if available. Only cells that straddle
+    // the surface of the spherocylinder need the exact test.
+    if (cells != nullptr)
+    {
+        int region = cells->getRegion(position);
+
+        if (region == CellList::INSIDE) return false;
+        if (region == CellList::OUTSIDE) return true;
+    }
+
     // Centre of sphere or circle.
-    std::vector<double> centre(3);
+    double centre[3];
 
     // Separation vector.
-    std::vector<double> sep(3);
+    double sep[3];
 
     // Squared radius of spherical cap (minus squared radius of particle).
     double radiusSqd = 0.25*(boxSize[0] - 1)*(boxSize[0] - 1);
@@ -257,38 +273,62 @@ bool Initialise::outsideSpherocylinder(unsigned int particle, const double* posi
     return false;
 }
 
+void Initialise::setSpherocylinderMask(CellList& cells_, Box& box)
+{
+    if (box.dimension != 3)
+    {
+        std::cerr << "[ERROR] Initialise: Spherocylindrical boundary only valid for three dimensional simulation box!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    // Copy box dimensions.
+    boxSize = box.boxSize;
+
+    using namespace std::placeholders;
+    // Inactive particles are parked outside of the spherocylinder, so keep their cell.
+    double park[3] = { PARK_POSITION, PARK_POSITION, PARK_POSITION };
+    cells_.setMask(std::bind(&Initialise::spherocylinderDistance, this, _1), park);
+
+    cells = &cells_;
+}
+
+double Initialise::spherocylinderDistance(const double* position) const
+{
+    // Radius of the spherocylinder.
+    double radius = 0.5*boxSize[0];
+
+    // Height of the point, clamped to the axis of the cylinder.
+    double z = position[2];
+    if (z < radius) z = radius;
+    else if (z > (boxSize[2] - radius)) z = boxSize[2] - radius;
+
+    double sep[3] = { position[0] - radius, position[1] - radius, position[2] - z };
+    return sqrt(sep[0]*sep[0] + sep[1]*sep[1] + sep[2]*sep[2]) - (radius - 0.5);
+}
+
 bool Initialise::checkOverlap(Particle& particle, std::vector<Particle>& particles, CellList& cells, Box& box)
 {
     unsigned int cell, neighbour;
 
     // Check all neighbouring cells including same cell.
-    for (unsigned int i=0;i<cells.getNeighbours();i++)
+    const unsigned int* neighbourCells = cells.getNeighbourCells(particle.cell);
+    unsigned int nNeighbours = cells.getNeighbours(particle.cell);
+
+    for (unsigned int i=0;i<nNeighbours;i++)
     {
-        cell = cells[particle.cell].neighbours[i];
+        cell = neighbourCells[i];
+        const unsigned int* cellParticles = cells.getParticles(cell);
 
         // Check all particles within cell.
-        for (unsigned int j=0;j<cells[cell].tally;j++)
+        for (unsigned int j=0;j<cells.getTally(cell);j++)
         {
-            neighbour = cells[cell].particles[j];
+            neighbour = cellParticles[j];
 
             // Make sure particles are different.
             if (neighbour != particle.index && particle.type !=0)
             {
-                // Particle separtion vector.
-                std::vector<double> sep(box.dimension);
-
-                // Compute separation.
-                for (unsigned int k=0;k<box.dimension;k++)
-                    sep[k] = particle.position[k] - particles[neighbour].position[k];
-
-                // Compute minimum image.
-                box.minimumImage(sep);
-
-                double normSqd = 0;
-
-                // Calculate squared norm of vector.
-                for (unsigned int k=0;k<box.dimension;k++)
-                    normSqd += sep[k]*sep[k];
+                // Squared minimum image separation.
+                double normSqd = box.computeSquaredDistance(&particle.position[0], &particles[neighbour].position[0]);
 
                 // Overlap if normSqd is less than particle diameter (box is scaled in diameter units).
                 if (normSqd < 1) return true;
@@ -299,3 +339,19 @@ bool Initialise::checkOverlap(Particle& particle, std::vector<Particle>& particl
     // If we get this far, no overlaps.
     return false;
 }
+
+bool Initialise::checkOverlaps(std::vector<Particle>& particles, CellList& cells, Box& box)
+{
+    // Each unordered pair is tested once, stopping at the first overlap.
+    return cells.forEachPair([&](unsigned int i, unsigned int j)
+    {
+        // Inactive particles can't overlap.
+        if (particles[i].type == 0 || particles[j].type == 0) return false;
+
+        // Squared minimum image separation.
+        double normSqd = box.computeSquaredDistance(&particles[i].position[0], &particles[j].position[0]);
+
+        // Overlap if normSqd is less than particle diameter (box is scaled in diameter units).
+        return (normSqd < 1);
+    });
+}
@@ -53,6 +53,19 @@ public:
      */
     void random(std::vector<Particle>&, CellList&, Box&, MersenneTwister&, bool, int);
 
+    //! Mask the cell list with the spherocylinder.
+    /*! Cells that lie wholly outside of the spherocylinder are dropped from the
+        cell list, and outsideSpherocylinder only performs the exact test for
+        particles in cells that straddle its surface. Call this before random.
+
+        \param cells
+            A reference to the cell list container.
+
+        \param box
+            A reference to the simulation box.
+     */
+    void setSpherocylinderMask(CellList&, Box&);
+
     //! Check whether particle is within spherocylinder.
     /*! \param index
             The particle index.
@@ -72,10 +85,37 @@ public:
     bool outsideSpherocylinder(unsigned int, const double*);
 #endif
 
+    //! Check whether any pair of active particles in a configuration overlap.
+    /*! \param particles
+            A reference to the particle list.
+
+        \param cells
+            A refernce to the cell list.
+
+        \param box
+            A reference to the simulation box.
+
+        \return
+            Whether the configuration contains an overlap.
+     */
+    bool checkOverlaps(std::vector<Particle>&, CellList&, Box&);
+
 private:
     /// Copy of the simulation box size.
     std::vector<double> boxSize;
 
+    /// Pointer to the masked cell list (null if there is no mask).
+    const CellList* cells;
+
+    //! Signed distance of a point from the surface of the spherocylinder.
+    /*! \param position
+            The coordinates of the point.
+
+        \return
+            The signed distance (negative inside) for the centre of a particle.
+     */
+    double spherocylinderDistance(const double*) const;
+
     //! Helper function for testing particle insertions.
     /*! \param particle
             A reference to the trial particle.
@@ -93,6 +133,9 @@ private:
 
     /// Maximum number of trial particle insertions (per particle).
     static const unsigned int MAX_TRIALS = 100000000;
+
+    /// Coordinate (along each axis) at which inactive particles are parked.
+    static constexpr double PARK_POSITION = 2.0;
 };
 
 #endif  /* _INITIALISE_H */
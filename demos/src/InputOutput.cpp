@@ -45,6 +45,7 @@ void InputOutput::loadConfiguration(std::string fileName, Box& box,
         {
             // Set particle index.
             particles[i].index = i;
+            particles[i].id = i;
 
             // Resize position and orientation vectors.
             particles[i].position.resize(box.dimension);
@@ -69,13 +70,10 @@ void InputOutput::loadConfiguration(std::string fileName, Box& box,
 
             // Enforce periodic boundary conditions.
             box.periodicBoundaries(particles[i].position);
-
-            // Calculate the particle's cell index.
-            particles[i].cell = cells.getCell(particles[i]);
-
-            // Update cell list.
-            cells.initCell(particles[i].cell, particles[i]);
         }
+
+        // Build the cell list (and any neighbour lists) in one pass.
+        cells.initCellList(particles);
     }
     else
     {
@@ -93,8 +91,14 @@ void InputOutput::saveConfiguration(std::string fileName, Box& box,
     // Create file pointer.
     FILE *pFile = fopen(fileName.c_str(), "w");
 
-    for (unsigned int i=0;i<particles.size();i++)
+    // Write particles in order of their external index.
+    std::vector<unsigned int> order;
+    externalOrder(particles, order);
+
+    for (unsigned int n=0;n<particles.size();n++)
     {
+        unsigned int i = order[n];
+
         // Write particle position.
         fprintf(pFile, "%5.4f %5.4f", particles[i].position[0], particles[i].position[1]);
         if (box.dimension == 3) fprintf(pFile, " %5.4f", particles[i].position[2]);
@@ -128,8 +132,13 @@ void InputOutput::appendXyzTrajectory(unsigned int dimension, const std::vector<
     pFile = fopen("trajectory2.xyz", "a");
     fprintf(pFile, "%lu\n\n", particles.size());
 
-    for (unsigned int i=0;i<particles.size();i++)
+    // Write particles in order of their external index.
+    std::vector<unsigned int> order;
+    externalOrder(particles, order);
+
+    for (unsigned int n=0;n<particles.size();n++)
     {
+        unsigned int i = order[n];
         fprintf(pFile, "%d %5.4f %5.4f %5.4f\n",particles[i].type,
             particles[i].position[0], particles[i].position[1], (dimension == 3) ? particles[i].position[2] : 0);
     }
@@ -264,3 +273,11 @@ void InputOutput::vmdSpherocylinder(const std::vector<double>& boxSize)
 
     fclose(pFile);
 }
+
+void InputOutput::externalOrder(const std::vector<Particle>& particles, std::vector<unsigned int>& order)
+{
+    order.resize(particles.size());
+
+    for (unsigned int i=0;i<particles.size();i++)
+        order[particles[i].id] = i;
+}
@@ -92,6 +92,16 @@ public:
             The size of the simulation box in each dimension.
      */
     void vmdSpherocylinder(const std::vector<double>&);
+
+private:
+    //! Get the storage index of each particle, ordered by external index.
+    /*! \param particles
+            A vector of particles.
+
+        \param order
+            A vector to store the storage index of the particle with each external index.
+     */
+    void externalOrder(const std::vector<Particle>&, std::vector<unsigned int>&);
 };
 
 #endif  /* _INPUTOUTPUT_H */
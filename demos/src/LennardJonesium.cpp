@@ -21,6 +21,7 @@
 #include "Particle.h"
 #include "CellList.h"
 #include "LennardJonesium.h"
+#include "Simd.h"
 
 LennardJonesium::LennardJonesium(
     Box& box_,
@@ -29,36 +30,26 @@ LennardJonesium::LennardJonesium(
     unsigned int maxInteractions_,
     double interactionEnergy_,
     double interactionRange_) :
-    Model(box_, particles_, cells_, maxInteractions_, interactionEnergy_, interactionRange_)
+    StaticModel<LennardJonesium>(box_, particles_, cells_, maxInteractions_, interactionEnergy_, interactionRange_)
 {
     // Work out the potential shift.
     potentialShift = std::pow(1.0/interactionRange, 12) - std::pow(1/interactionRange, 6);
 }
 
 #ifndef ISOTROPIC
-double LennardJonesium::computePairEnergy(const unsigned int particle1, const double* position1, const unsigned int type1,
-    const double* orientation1, const unsigned int particle2, const double* position2,const unsigned int type2, const double* orientation2)
+double LennardJonesium::computePairEnergyFromDistance(unsigned int particle1, const double* position1, unsigned int type1,
+    const double* orientation1, unsigned int particle2, const double* position2, unsigned int type2,
+    const double* orientation2, double normSqd)
 #else
-double LennardJonesium::computePairEnergy(const unsigned int particle1,
-    const double* position1, const unsigned int type1, const unsigned int particle2, const double* position2, const unsigned int type2)
+double LennardJonesium::computePairEnergyFromDistance(unsigned int particle1, const double* position1, unsigned int type1,
+    unsigned int particle2, const double* position2, unsigned int type2, double normSqd)
 #endif
 {
-    // Separation vector.
-    std::vector<double> sep(box.dimension);
-
-    // Calculate separation.
-    for (unsigned int i=0;i<box.dimension;i++)
-        sep[i] = position1[i] - position2[i];
-
-    // Enforce minimum image.
-    box.minimumImage(sep);
-
-    double normSqd = 0;
-
-    // Calculate squared norm of vector.
-    for (unsigned int i=0;i<box.dimension;i++)
-        normSqd += sep[i]*sep[i];
+    return computeRadialEnergy(normSqd, type1, type2);
+}
 
+double LennardJonesium::computeRadialEnergy(double normSqd, unsigned int type1, unsigned int type2) const
+{
     // Particles interact.
     if (normSqd < squaredCutOffDistance)
     {
@@ -68,3 +59,34 @@ double LennardJonesium::computePairEnergy(const unsigned int particle1,
     }
     else return 0;
 }
+
+#ifndef ISOTROPIC
+void LennardJonesium::computeBatchEnergies(unsigned int particle, const double* position, unsigned int type,
+    const double* orientation, NeighbourBatch& batch)
+#else
+void LennardJonesium::computeBatchEnergies(unsigned int particle, const double* position, unsigned int type,
+    NeighbourBatch& batch)
+#endif
+{
+    const double* inverseBoxSize = &box.getInverseBoxSize()[0];
+
+    simd::Double zero = simd::set(0);
+    simd::Double one = simd::set(1.0);
+    simd::Double scale = simd::set(4.0*interactionEnergy);
+    simd::Double shift = simd::set(potentialShift);
+    simd::Double cutOff = simd::set(squaredCutOffDistance);
+
+    // Process whole vectors (the batch capacity is padded to the SIMD width).
+    for (unsigned int i=0;i<batch.size;i+=simd::WIDTH)
+    {
+        simd::Double normSqd = simd::squaredDistance(position, &batch.coordinates[0],
+            batch.capacity, i, &box.boxSize[0], inverseBoxSize, box.dimension);
+
+        simd::Double r2Inv = one / normSqd;
+        simd::Double r6Inv = r2Inv*r2Inv*r2Inv;
+        simd::Double energy = scale*((r6Inv*r6Inv) - r6Inv - shift);
+
+        simd::store(&batch.energies[i], simd::select(normSqd < cutOff, energy, zero));
+        simd::store(&batch.squaredDistances[i], normSqd);
+    }
+}
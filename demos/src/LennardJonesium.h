@@ -18,14 +18,16 @@
 #ifndef _LENNARDJONESIUM_H
 #define _LENNARDJONESIUM_H
 
-#include "Model.h"
+#include "StaticModel.h"
 
 /*! \file LennardJonesium.h
 */
 
 //! Class defining the Lennard-Jones potential.
-class LennardJonesium : public Model
+class LennardJonesium : public StaticModel<LennardJonesium>
 {
+    friend class StaticModel<LennardJonesium>;
+
 public:
     //! Constructor.
     /*! \param box_
@@ -48,13 +50,35 @@ public:
      */
     LennardJonesium(Box&, std::vector<Particle>&, CellList&, unsigned int, double, double);
 
-    //! Calculate the pair energy between two particles.
+    //! Calculate the pair energy for a given squared separation.
+    /*! This is the analytic form of the potential, e.g. for tabulation
+        by TabulatedModel.
+
+        \param normSqd
+            The squared separation between the particles.
+
+        \param type1
+            The type of the first particle.
+
+        \param type2
+            The type of the second particle.
+
+        \return
+            The pair energy.
+     */
+    double computeRadialEnergy(double, unsigned int, unsigned int) const;
+
+protected:
+    //! Calculate the pair energy between two particles with a known separation.
     /*! \param particle1
             The index of the first particle.
 
         \param position1
             The position vector of the first particle.
 
+        \param type1
+            The type of the first particle.
+
         \param orientation1
             The orientation vector of the first particle.
 
@@ -64,16 +88,46 @@ public:
         \param position2
             The position vector of the second particle.
 
+        \param type2
+            The type of the second particle.
+
         \param orientation2
             The orientation vector of the second particle.
 
+        \param normSqd
+            The squared minimum image separation between the particles.
+
         \return
             The pair energy between particles 1 and 2.
      */
 #ifndef ISOTROPIC
-    double computePairEnergy(unsigned int, const double*, unsigned int, const double*, unsigned int, const double*, unsigned int,const double*);
+    double computePairEnergyFromDistance(unsigned int, const double*, unsigned int, const double*,
+        unsigned int, const double*, unsigned int, const double*, double);
+#else
+    double computePairEnergyFromDistance(unsigned int, const double*, unsigned int,
+        unsigned int, const double*, unsigned int, double);
+#endif
+
+    //! Calculate pair energies with a batch of packed neighbours, using SIMD.
+    /*! \param particle
+            The index of the particle.
+
+        \param position
+            The position vector of the particle.
+
+        \param type
+            The type of the particle.
+
+        \param orientation
+            The orientation vector of the particle.
+
+        \param batch
+            The packed neighbours.
+     */
+#ifndef ISOTROPIC
+    void computeBatchEnergies(unsigned int, const double*, unsigned int, const double*, NeighbourBatch&);
 #else
-    double computePairEnergy(unsigned int, const double*, unsigned int, unsigned int, const double*, unsigned int);
+    void computeBatchEnergies(unsigned int, const double*, unsigned int, NeighbourBatch&);
 #endif
 
 private:
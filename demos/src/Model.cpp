@@ -15,14 +15,17 @@
   along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <limits>
+#include <utility>
 
 #include "Box.h"
 #include "CellList.h"
 #include "Model.h"
 #include "Particle.h"
+#include "Simd.h"
 
 double INF = std::numeric_limits<double>::infinity();
 
@@ -39,126 +42,190 @@ Model::Model(
     cells(cells_),
     maxInteractions(maxInteractions_),
     interactionEnergy(interactionEnergy_),
-    interactionRange(interactionRange_)
+    interactionRange(interactionRange_),
+    nTypes(0)
 {
     // Work out squared cut-off distance.
     squaredCutOffDistance = interactionRange * interactionRange;
+
+    neighbourBatch.size = 0;
+    neighbourBatch.capacity = 0;
 }
 
 #ifndef ISOTROPIC
-double Model::computeEnergy(unsigned int particle, const double* position, unsigned int type, const double* orientation)
+unsigned int Model::computeInteractions(unsigned int particle,
+    const double* position, const double* orientation, unsigned int* interactions)
 #else
-double Model::computeEnergy(unsigned int particle, const double* position, unsigned int type)
+unsigned int Model::computeInteractions(unsigned int particle,
+    const double* position, unsigned int* interactions)
 #endif
 {
-    // N.B. This method is somewhat redundant since the same functionality
-    // could be achieved by using a combination of the computeInteractions
-    // and model specific computePairEnergy methods.
+    // Interaction counter.
+    unsigned int nInteractions = 0;
 
-    // Energy counter.
-    double energy = 0;
+    // Type of the particle.
+    unsigned int type = particles[particle].type;
 
-    // Check all neighbouring cells including same cell.
-    for (unsigned int i=0;i<cells.getNeighbours();i++)
-    {
-        // Cell index.
-        unsigned int cell = cells[particles[particle].cell].neighbours[i];
+    // Bring the Verlet lists up to date following any moves.
+    cells.refreshNeighbourLists(particles);
+
+    // Check all blocks of candidate neighbours, i.e. the neighbouring cells
+    // (including same cell), or the particle's Verlet list.
+    unsigned int nBlocks = cells.getNeighbourBlocks(particles[particle]);
+
+    // Number of partner types that can interact with the particle.
+    unsigned int nPartners = getPartners(type);
 
-        // Check all particles within cell.
-        for (unsigned int j=0;j<cells[cell].tally;j++)
+    for (unsigned int i=0;i<nBlocks;i++)
+    {
+        // Check each partner type (all particles if there is no type-pair range table).
+        for (unsigned int t=0;t<nPartners;t++)
         {
-            // Index of neighbouring particle.
-            unsigned int neighbour = cells[cell].particles[j];
-            
+            const unsigned int* blockParticles;
+            unsigned int tally = getNeighbourParticles(particle, i, type, t, blockParticles);
 
-            // Make sure the particles are different.
-            if (neighbour != particle)
+            // Check all particles within block.
+            for (unsigned int j=0;j<tally;j++)
             {
-                // Calculate model specific pair energy.
-#ifndef ISOTROPIC
-                energy += computePairEnergy(particle, position, type, orientation,
-                          neighbour, &particles[neighbour].position[0], particles[neighbour].type,
-                          &particles[neighbour].orientation[0]);
-#else
-                energy += computePairEnergy(particle, position, type,
-                          neighbour, &particles[neighbour].position[0], particles[neighbour].type);
-#endif
+                // Index of neighbouring particle.
+                unsigned int neighbour = blockParticles[j];
+
+                // Make sure the particles are different.
+                if (neighbour != particle)
+                {
+                    // Squared minimum image separation.
+                    double normSqd = box.computeSquaredDistance(position, &particles[neighbour].position[0]);
 
-                // Early exit test for hard core overlaps and large finite energy repulsions.
-                if (energy > 1e6) return INF;
+                    // Particles interact.
+                    if (normSqd < getSquaredCutOff(type, particles[neighbour].type))
+                    {
+                        if (nInteractions == maxInteractions)
+                        {
+                            std::cerr << "[ERROR] Model: Maximum number of interactions exceeded!\n";
+                            exit(EXIT_FAILURE);
+                        }
+
+                        interactions[nInteractions] = neighbour;
+                        nInteractions++;
+                    }
+                }
             }
         }
     }
 
-    return energy;
+    return nInteractions;
 }
 
-#ifndef ISOTROPIC
-double Model::computePairEnergy(unsigned int particle1, const double* position1, unsigned int type1, const double* orientation1,
-    unsigned int particle2, const double* position2, unsigned int type2, const double* orientation2)
-#else
-double Model::computePairEnergy(unsigned int particle1,
-    const double* position1,unsigned int type1, unsigned int particle2, const double* position2, unsigned int type2)
-#endif
+void Model::gatherNeighbours(unsigned int particle, unsigned int type, const char* isMoving)
 {
-    std::cerr << "[ERROR] Model: Virtual function Model::computePairEnergy() must be defined.\n";
-    exit(EXIT_FAILURE);
+    neighbourBatch.size = 0;
+
+    // Bring the Verlet lists up to date following any moves.
+    cells.refreshNeighbourLists(particles);
+
+    // Check all blocks of candidate neighbours, i.e. the neighbouring cells
+    // (including same cell), or the particle's Verlet list.
+    unsigned int nBlocks = cells.getNeighbourBlocks(particles[particle]);
+
+    // Number of partner types that can interact with the particle.
+    unsigned int nPartners = getPartners(type);
+
+    for (unsigned int i=0;i<nBlocks;i++)
+    {
+        // Check each partner type (all particles if there is no type-pair range table).
+        for (unsigned int t=0;t<nPartners;t++)
+        {
+            const unsigned int* blockParticles;
+            unsigned int tally = getNeighbourParticles(particle, i, type, t, blockParticles);
+
+            for (unsigned int j=0;j<tally;j++)
+            {
+                // Index of neighbouring particle.
+                unsigned int neighbour = blockParticles[j];
+
+                // Skip the particle itself and any excluded particles.
+                if (isMoving != nullptr)
+                {
+                    if (isMoving[neighbour]) continue;
+                }
+                else if (neighbour == particle) continue;
+
+                appendNeighbour(neighbour);
+            }
+        }
+    }
 }
 
-#ifndef ISOTROPIC
-unsigned int Model::computeInteractions(unsigned int particle,
-    const double* position, const double* orientation, unsigned int* interactions)
-#else
-unsigned int Model::computeInteractions(unsigned int particle,
-    const double* position, unsigned int* interactions)
-#endif
+void Model::appendNeighbour(unsigned int neighbour)
 {
-    // Interaction counter.
-    unsigned int nInteractions = 0;
+    NeighbourBatch& batch = neighbourBatch;
 
-    // Check all neighbouring cells including same cell.
-    for (unsigned int i=0;i<cells.getNeighbours();i++)
+    // Grow the batch, keeping the capacity a multiple of the SIMD width.
+    if (batch.size == batch.capacity)
     {
-        // Cell index.
-        unsigned int cell = cells[particles[particle].cell].neighbours[i];
+        unsigned int capacity = std::max(2*batch.capacity, 16*simd::WIDTH);
+
+        std::vector<double> coordinates(box.dimension*capacity);
+        for (unsigned int i=0;i<box.dimension;i++)
+            std::copy(&batch.coordinates[0] + i*batch.capacity, &batch.coordinates[0] + i*batch.capacity + batch.size,
+                &coordinates[0] + i*capacity);
+
+        batch.coordinates.swap(coordinates);
+        batch.indices.resize(capacity);
+        batch.types.resize(capacity);
+        batch.energies.resize(capacity);
+        batch.squaredDistances.resize(capacity);
+        batch.capacity = capacity;
+    }
 
-        // Check all particles within cell.
-        for (unsigned int j=0;j<cells[cell].tally;j++)
-        {
-            // Index of neighbouring particle.
-            unsigned int neighbour = cells[cell].particles[j];
+    batch.indices[batch.size] = neighbour;
+    batch.types[batch.size] = particles[neighbour].type;
 
-            // Make sure the particles are different.
-            if (neighbour != particle)
-            {
-                std::vector<double> sep(box.dimension);
+    for (unsigned int i=0;i<box.dimension;i++)
+        batch.coordinates[i*batch.capacity + batch.size] = particles[neighbour].position[i];
 
-                // Compute separation.
-                for (unsigned int k=0;k<box.dimension;k++)
-                    sep[k] = position[k] - particles[neighbour].position[k];
+    batch.size++;
+}
 
-                // Enforce minimum image.
-                box.minimumImage(sep);
+double Model::sumBatchEnergies() const
+{
+    // Energy counter.
+    double energy = 0;
 
-                double normSqd = 0;
+    for (unsigned int i=0;i<neighbourBatch.size;i++)
+        energy += neighbourBatch.energies[i];
 
-                // Calculate squared norm of vector.
-                for (unsigned int k=0;k<box.dimension;k++)
-                    normSqd += sep[k]*sep[k];
+    // Test for hard core overlaps and large finite energy repulsions.
+    if (energy > 1e6) return INF;
 
-                // Particles interact.
-                if (normSqd < squaredCutOffDistance)
-                {
-                    if (nInteractions == maxInteractions)
-                    {
-                        std::cerr << "[ERROR] Model: Maximum number of interactions exceeded!\n";
-                        exit(EXIT_FAILURE);
-                    }
+    return energy;
+}
 
-                    interactions[nInteractions] = neighbour;
-                    nInteractions++;
-                }
+unsigned int Model::collectInteractions(unsigned int type, unsigned int* interactions,
+    double* energies, double* squaredDistances) const
+{
+    // Interaction counter.
+    unsigned int nInteractions = 0;
+
+    for (unsigned int i=0;i<neighbourBatch.size;i++)
+    {
+        double normSqd = neighbourBatch.squaredDistances[i];
+
+        // Particles interact.
+        if (normSqd < getSquaredCutOff(type, neighbourBatch.types[i]))
+        {
+            if (nInteractions == maxInteractions)
+            {
+                std::cerr << "[ERROR] Model: Maximum number of interactions exceeded!\n";
+                exit(EXIT_FAILURE);
             }
+
+            interactions[nInteractions] = neighbourBatch.indices[i];
+            energies[nInteractions] = neighbourBatch.energies[i];
+
+            if (squaredDistances != nullptr) squaredDistances[nInteractions] = normSqd;
+
+            nInteractions++;
         }
     }
 
@@ -181,24 +248,116 @@ void Model::applyPostMoveUpdates(unsigned int particle, const double* position)
 #endif
     }
 
-    // Calculate the particle's cell index.
-    unsigned int newCell = cells.getCell(particles[particle]);
+    // Update the cell list (and any neighbour lists).
+    cells.updateParticle(particles[particle], particles);
+}
+
+void Model::setInteractionRanges(unsigned int nTypes_, const std::vector<double>& ranges)
+{
+    if (ranges.size() != nTypes_*nTypes_)
+    {
+        std::cerr << "[ERROR] Model: Interaction range table must have nTypes x nTypes entries!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    nTypes = nTypes_;
+    squaredTypeCutOffs.resize(nTypes*nTypes);
+    partnerTypes.resize(nTypes);
+
+    for (unsigned int i=0;i<nTypes;i++)
+    {
+        partnerTypes[i].clear();
+
+        for (unsigned int j=0;j<nTypes;j++)
+        {
+            double range = ranges[i*nTypes + j];
+
+            if ((range != ranges[j*nTypes + i]) || (range > interactionRange))
+            {
+                std::cerr << "[ERROR] Model: Interaction range table must be symmetric and within the model interaction range!\n";
+                exit(EXIT_FAILURE);
+            }
+
+            squaredTypeCutOffs[i*nTypes + j] = range*range;
 
-    // Update cell lists if necessary.
-    if (particles[particle].cell != newCell)
-        cells.updateCell(newCell, particles[particle], particles);
+            // Types that interact at some distance.
+            if (range > 0) partnerTypes[i].push_back(j);
+        }
+    }
+
+    // Switch the cell list to per-type occupancy.
+    cells.setTypes(nTypes);
+    cells.initCellList(particles);
+}
+
+void Model::reorder(const unsigned int* order)
+{
+    // Permute the particle list.
+    std::vector<Particle> newParticles(particles.size());
+
+    for (unsigned int i=0;i<particles.size();i++)
+    {
+        std::swap(newParticles[i], particles[order[i]]);
+        newParticles[i].index = i;
+    }
+
+    particles.swap(newParticles);
+
+    // Rebuild the cell list, so that cells store the new indices.
+    cells.reset();
+    cells.initCellList(particles);
+}
+
+void Model::applyVolumeChange(const double* boxSize, const double* coordinates)
+{
+    box.setBoxSize(std::vector<double>(boxSize, boxSize + box.dimension));
+
+    for (unsigned int i=0;i<particles.size();i++)
+        for (unsigned int j=0;j<box.dimension;j++)
+            particles[i].position[j] = coordinates[box.dimension*i + j];
+
+    // Rescale the cell spacing in place rather than rebuilding.
+    cells.rescale(box.boxSize, particles);
 }
 
 double Model::getEnergy()
 {
     double energy = 0;
 
-    for (unsigned int i=0;i<particles.size();i++)
+    // Sum over unordered pairs using the half-shell stencil, so that each
+    // pair energy is only evaluated once.
+    cells.forEachPair([&](unsigned int i, unsigned int j)
+    {
 #ifndef ISOTROPIC
-        energy += computeEnergy(i, &particles[i].position[0], particles[i].type, &particles[i].orientation[0]);
+        energy += computePairEnergy(i, &particles[i].position[0], particles[i].type, &particles[i].orientation[0],
+                  j, &particles[j].position[0], particles[j].type, &particles[j].orientation[0]);
 #else
-        energy += computeEnergy(i, &particles[i].position[0], particles[i].type);
+        energy += computePairEnergy(i, &particles[i].position[0], particles[i].type,
+                  j, &particles[j].position[0], particles[j].type);
 #endif
+        return false;
+    });
+
+    return energy/particles.size();
+}
 
-    return energy/(2*particles.size());
+unsigned int Model::getPartners(unsigned int type) const
+{
+    if (nTypes == 0) return 1;
+    else return partnerTypes[type].size();
+}
+
+unsigned int Model::getNeighbourParticles(unsigned int particle, unsigned int block,
+    unsigned int type, unsigned int partner, const unsigned int*& blockParticles) const
+{
+    if (nTypes == 0)
+        return cells.getNeighbourBlock(particles[particle], block, blockParticles);
+    else
+        return cells.getNeighbourBlock(particles[particle], block, partnerTypes[type][partner], blockParticles);
+}
+
+double Model::getSquaredCutOff(unsigned int type1, unsigned int type2) const
+{
+    if (nTypes == 0) return squaredCutOffDistance;
+    else return squaredTypeCutOffs[type1*nTypes + type2];
 }
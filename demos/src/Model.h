@@ -32,10 +32,26 @@ struct Particle;
 extern double INF;
 
 //! Base class defining general access functions for the model potential
-//! and a virtual interface for model specific pair energies.
+//! and a virtual interface for model specific pair energies (implemented
+//! by StaticModel).
 class Model
 {
 public:
+    //! Packed (structure-of-arrays) candidate neighbours for batch pair energies.
+    /*! The capacity is a multiple of the SIMD width, so kernels can process
+        whole vectors. Lanes beyond the size hold stale (finite) data.
+     */
+    struct NeighbourBatch
+    {
+        unsigned int size;                      //!< The number of neighbours.
+        unsigned int capacity;                  //!< The number of neighbours that can be stored.
+        std::vector<unsigned int> indices;      //!< The index of each neighbour.
+        std::vector<unsigned int> types;        //!< The type of each neighbour.
+        std::vector<double> coordinates;        //!< Neighbour coordinates (capacity entries per axis, axis by axis).
+        std::vector<double> energies;           //!< The pair energy with each neighbour.
+        std::vector<double> squaredDistances;   //!< The squared minimum image separation from each neighbour.
+    };
+
     //! Constructor.
     /*! \param box_
             A reference to the simulation box object.
@@ -71,9 +87,34 @@ public:
             The total interaction energy.
      */
 #ifndef ISOTROPIC
-    virtual double computeEnergy(unsigned int, const double*, unsigned int, const double*);
+    virtual double computeEnergy(unsigned int, const double*, unsigned int, const double*) = 0;
+#else
+    virtual double computeEnergy(unsigned int, const double*, unsigned int) = 0;
+#endif
+
+    //! Calculate the interaction energy felt by a particle due to particles outside the moving cluster.
+    /*! \param index
+            The particle index.
+
+        \param position
+            The position vector of the particle.
+
+        \param type
+            The type of the particle.
+
+        \param orientation
+            The orientation vector of the particle.
+
+        \param isMoving
+            Mask of particle indices, non-zero if the particle is part of the moving cluster.
+
+        \return
+            The interaction energy due to non-moving neighbours.
+     */
+#ifndef ISOTROPIC
+    virtual double computeExternalEnergy(unsigned int, const double*, unsigned int, const double*, const char*) = 0;
 #else
-    virtual double computeEnergy(unsigned int, const double*, unsigned int);
+    virtual double computeExternalEnergy(unsigned int, const double*, unsigned int, const char*) = 0;
 #endif
 
     //! Calculate the pair energy between two particles.
@@ -99,9 +140,48 @@ public:
             The pair energy between particles 1 and 2.
      */
 #ifndef ISOTROPIC
-    virtual double computePairEnergy(unsigned int, const double*, unsigned int, const double*, unsigned int, const double*, unsigned int, const double*);
+    virtual double computePairEnergy(unsigned int, const double*, unsigned int, const double*, unsigned int, const double*, unsigned int, const double*) = 0;
 #else
-    virtual double computePairEnergy(unsigned int, const double*, unsigned int,unsigned int, const double*,unsigned int);
+    virtual double computePairEnergy(unsigned int, const double*, unsigned int,unsigned int, const double*,unsigned int) = 0;
+#endif
+
+    //! Calculate the pair energy between two particles for several configurations of the first particle.
+    /*! \param particle1
+            The index of the first particle.
+
+        \param positions1
+            Pointers to the position vectors of the first particle.
+
+        \param type1
+            The type of the first particle.
+
+        \param orientations1
+            Pointers to the orientation vectors of the first particle.
+
+        \param nConfigurations
+            The number of configurations of the first particle.
+
+        \param particle2
+            The index of the second particle.
+
+        \param position2
+            The position vector of the second particle.
+
+        \param type2
+            The type of the second particle.
+
+        \param orientation2
+            The orientation vector of the second particle.
+
+        \param energies
+            An array to store the pair energy for each configuration.
+     */
+#ifndef ISOTROPIC
+    virtual void computePairEnergy3(unsigned int, const double* const*, unsigned int, const double* const*, unsigned int,
+        unsigned int, const double*, unsigned int, const double*, double*) = 0;
+#else
+    virtual void computePairEnergy3(unsigned int, const double* const*, unsigned int, unsigned int,
+        unsigned int, const double*, unsigned int, double*) = 0;
 #endif
 
     //! Determine the interactions for a given particle.
@@ -126,6 +206,70 @@ public:
     virtual unsigned int computeInteractions(unsigned int, const double*, unsigned int*);
 #endif
 
+    //! Determine the interactions for a given particle along with their pair energies.
+    /*! The neighbour search and the pair energies share a single pass over the
+        candidate neighbours, i.e. the separation of each neighbour is only computed once.
+
+        \param particle
+            The particle index.
+
+        \param position
+            The position vector of the particle.
+
+        \param type
+            The type of the particle.
+
+        \param orientation
+            The orientation vector of the particle.
+
+        \param interactions
+            An array to store the indices of neighbours with which the particle interacts.
+
+        \param energies
+            An array to store the pair energy for each interaction.
+
+        \param squaredDistances
+            An array to store the squared separation for each interaction (may be null).
+
+        \return
+            The number of interactions.
+     */
+#ifndef ISOTROPIC
+    virtual unsigned int computeInteractionEnergies(unsigned int, const double*, unsigned int, const double*, unsigned int*, double*, double*) = 0;
+#else
+    virtual unsigned int computeInteractionEnergies(unsigned int, const double*, unsigned int, unsigned int*, double*, double*) = 0;
+#endif
+
+    //! Calculate the pair energy between a particle and each of a list of other particles.
+    /*! The neighbours are packed and evaluated with the batch kernel of the model.
+
+        \param particle
+            The particle index.
+
+        \param position
+            The position vector of the particle.
+
+        \param type
+            The type of the particle.
+
+        \param orientation
+            The orientation vector of the particle.
+
+        \param nNeighbours
+            The number of neighbours.
+
+        \param neighbours
+            The indices of the neighbours.
+
+        \param energies
+            An array to store the pair energy with each neighbour.
+     */
+#ifndef ISOTROPIC
+    virtual void computePairEnergies(unsigned int, const double*, unsigned int, const double*, unsigned int, const unsigned int*, double*) = 0;
+#else
+    virtual void computePairEnergies(unsigned int, const double*, unsigned int, unsigned int, const unsigned int*, double*) = 0;
+#endif
+
     //! Apply any post-move updates for a given particle.
     /*! \param particle
             The particle index.
@@ -142,6 +286,39 @@ public:
     virtual void applyPostMoveUpdates(unsigned int, const double*);
 #endif
 
+    //! Apply a new particle ordering, e.g. following a call to VMMC::reorder.
+    /*! \param order
+            The new particle ordering: order[i] is the previous index of the
+            particle that now has index i.
+     */
+    virtual void reorder(const unsigned int*);
+
+    //! Apply a change in box size, e.g. following a VMMC::volumeMove.
+    /*! The box, particle positions, and cell list are updated together.
+
+        \param boxSize
+            The new size of the simulation box in each dimension.
+
+        \param coordinates
+            The coordinates of all particles in the rescaled box.
+     */
+    virtual void applyVolumeChange(const double*, const double*);
+
+    //! Set the interaction range for each pair of particle types.
+    /*! Neighbour queries then only visit particles whose type can interact
+        with that of the query particle, and only count interactions within
+        the range for that pair of types. The cell list is switched to
+        per-type occupancy and rebuilt. Pairs of types with zero range must
+        never interact, and no range may exceed the model interaction range.
+
+        \param nTypes_
+            The number of particle types.
+
+        \param ranges
+            The interaction range for each pair of types (nTypes x nTypes, row major).
+     */
+    void setInteractionRanges(unsigned int, const std::vector<double>&);
+
     //! Get the average pair energy.
     /*! \return
             The average pair energy.
@@ -153,10 +330,168 @@ public:
     CellList& cells;                    //!< A reference to the cell list.
 
 protected:
+    //! Calculate the pair energy between two particles with a known separation.
+    /*! Neighbour loops already know the minimum image separation, so models
+        define this rather than recomputing it (see StaticModel).
+
+        \param particle1
+            The index of the first particle.
+
+        \param position1
+            The position vector of the first particle.
+
+        \param type1
+            The type of the first particle.
+
+        \param orientation1
+            The orientation vector of the first particle.
+
+        \param particle2
+            The index of the second particle.
+
+        \param position2
+            The position vector of the second particle.
+
+        \param type2
+            The type of the second particle.
+
+        \param orientation2
+            The orientation vector of the second particle.
+
+        \param normSqd
+            The squared minimum image separation between the particles.
+
+        \return
+            The pair energy between particles 1 and 2.
+     */
+#ifndef ISOTROPIC
+    virtual double computePairEnergyFromDistance(unsigned int, const double*, unsigned int, const double*,
+        unsigned int, const double*, unsigned int, const double*, double) = 0;
+#else
+    virtual double computePairEnergyFromDistance(unsigned int, const double*, unsigned int,
+        unsigned int, const double*, unsigned int, double) = 0;
+#endif
+
+    //! Calculate the pair energy between a particle and a batch of neighbours.
+    /*! The energies and squared minimum image separations are stored in the
+        batch. StaticModel evaluates each pair with computePairEnergyFromDistance,
+        and radial models replace this with SIMD kernels (see Simd.h).
+
+        \param particle
+            The index of the particle.
+
+        \param position
+            The position vector of the particle.
+
+        \param type
+            The type of the particle.
+
+        \param orientation
+            The orientation vector of the particle.
+
+        \param batch
+            The packed neighbours.
+     */
+#ifndef ISOTROPIC
+    virtual void computeBatchEnergies(unsigned int, const double*, unsigned int, const double*, NeighbourBatch&) = 0;
+#else
+    virtual void computeBatchEnergies(unsigned int, const double*, unsigned int, NeighbourBatch&) = 0;
+#endif
+
+    //! Pack the candidate neighbours of a particle into the batch.
+    /*! \param particle
+            The index of the particle.
+
+        \param type
+            The type of the particle.
+
+        \param isMoving
+            Flags for particles to exclude, e.g. the moving cluster (may be null).
+     */
+    void gatherNeighbours(unsigned int, unsigned int, const char*);
+
+    //! Append a particle to the batch, growing it if needed.
+    /*! \param neighbour
+            The index of the particle.
+     */
+    void appendNeighbour(unsigned int);
+
+    //! Sum the pair energies in the batch.
+    /*! \return
+            The total energy (infinite for hard core overlaps and large finite repulsions).
+     */
+    double sumBatchEnergies() const;
+
+    //! Copy the interacting neighbours in the batch, i.e. those within the cut-off.
+    /*! \param type
+            The type of the particle.
+
+        \param interactions
+            An array to store the indices of the interacting neighbours.
+
+        \param energies
+            An array to store the pair energy for each interaction.
+
+        \param squaredDistances
+            An array to store the squared separation for each interaction (may be null).
+
+        \return
+            The number of interactions.
+     */
+    unsigned int collectInteractions(unsigned int, unsigned int*, double*, double*) const;
+
+    NeighbourBatch neighbourBatch;      //!< Packed candidate neighbours (scratch space).
+
     unsigned int maxInteractions;       //!< The maximum number of interactions per particle.
     double interactionEnergy;           //!< Interaction energy scale (in units of kBT).
     double interactionRange;            //!< Size of interaction range (in units of particle diameter).
     double squaredCutOffDistance;       //!< The squared cut-off distance.
+
+    unsigned int nTypes;                                //!< The number of particle types in the range table (zero if unset).
+    std::vector<double> squaredTypeCutOffs;             //!< The squared cut-off distance for each pair of types.
+    std::vector<std::vector<unsigned int> > partnerTypes;   //!< The types that can interact with each type.
+
+    //! Get the number of partner types to visit for a particle type.
+    /*! \param type
+            The particle type.
+
+        \return
+            The number of partner types (one, meaning all particles, if there is no range table).
+     */
+    unsigned int getPartners(unsigned int) const;
+
+    //! Get the particles of a partner type within a block of candidate neighbours.
+    /*! \param particle
+            The index of the query particle.
+
+        \param block
+            The block index (from zero to CellList::getNeighbourBlocks).
+
+        \param type
+            The type of the query particle.
+
+        \param partner
+            The partner type index (from zero to getPartners(type)).
+
+        \param blockParticles
+            A pointer to the particle indices (output).
+
+        \return
+            The number of particles.
+     */
+    unsigned int getNeighbourParticles(unsigned int, unsigned int, unsigned int, unsigned int, const unsigned int*&) const;
+
+    //! Get the squared cut-off distance for a pair of types.
+    /*! \param type1
+            The type of the first particle.
+
+        \param type2
+            The type of the second particle.
+
+        \return
+            The squared cut-off distance.
+     */
+    double getSquaredCutOff(unsigned int, unsigned int) const;
 };
 
 #endif  /* _MODEL_H */
@@ -0,0 +1,286 @@
+/*
+  Copyright (c) 2015-2016 Lester Hedges <lester.hedges+vmmc@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include "Box.h"
+#include "CellList.h"
+#include "Particle.h"
+#include "MultiSpeciesModel.h"
+
+#ifndef M_PI
+    #define M_PI 3.1415926535897932384626433832795
+#endif
+
+MultiSpeciesModel::MultiSpeciesModel(
+    Box& box_,
+    std::vector<Particle>& particles_,
+    CellList& cells_,
+    unsigned int maxInteractions_,
+    double interactionEnergy_,
+    double interactionRange_) :
+    StaticModel<MultiSpeciesModel>(box_, particles_, cells_, maxInteractions_, interactionEnergy_, interactionRange_)
+{
+}
+
+void MultiSpeciesModel::setParameters(unsigned int nTypes_, const std::vector<PairParameters>& parameters)
+{
+    if (parameters.size() != nTypes_*nTypes_)
+    {
+        std::cerr << "[ERROR] MultiSpeciesModel: Parameter table must have nTypes x nTypes entries!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    if (nTypes_ == 0)
+    {
+        std::cerr << "[ERROR] MultiSpeciesModel: Number of particle types must be > 0!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    // Every particle must have an entry in the table.
+    for (unsigned int i=0;i<particles.size();i++)
+    {
+        if (particles[i].type >= nTypes_)
+        {
+            std::cerr << "[ERROR] MultiSpeciesModel: Particle type out of range!\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    std::vector<double> ranges(nTypes_*nTypes_);
+    coefficients.resize(nTypes_*nTypes_);
+
+    for (unsigned int i=0;i<nTypes_*nTypes_;i++)
+    {
+        const PairParameters& pair = parameters[i];
+
+        // Pairs with a core must be within the cut-off to detect overlaps.
+        if ((pair.potential != NONE) && ((pair.sigma <= 0) || (pair.cutOff < pair.sigma)))
+        {
+            std::cerr << "[ERROR] MultiSpeciesModel: Pair cut-off must be at least sigma (and sigma > 0)!\n";
+            exit(EXIT_FAILURE);
+        }
+
+        ranges[i] = (pair.potential == NONE) ? 0 : pair.cutOff;
+        coefficients[i] = compile(pair);
+    }
+
+    // Validate the cut-offs and prune the neighbour search by type.
+    setInteractionRanges(nTypes_, ranges);
+}
+
+void MultiSpeciesModel::loadParameters(std::string fileName, unsigned int nTypes_)
+{
+    std::ifstream dataFile;
+
+    // Pairs that aren't listed don't interact.
+    PairParameters none = {NONE, 0, 0, 0};
+    std::vector<PairParameters> parameters(nTypes_*nTypes_, none);
+
+    // Attempt to read data file.
+    dataFile.open(fileName.c_str());
+
+    // Check that the file is valid.
+    if (dataFile.good())
+    {
+        unsigned int type1, type2;
+        std::string potential;
+        PairParameters pair;
+
+        while (dataFile >> type1)
+        {
+            if (!(dataFile >> type2 >> potential >> pair.epsilon >> pair.sigma >> pair.cutOff))
+            {
+                std::cerr << "[ERROR] MultiSpeciesModel: Invalid parameter file!\n";
+                exit(EXIT_FAILURE);
+            }
+
+            if (potential == "none") pair.potential = NONE;
+            else if (potential == "hard_sphere") pair.potential = HARD_SPHERE;
+            else if (potential == "square_well") pair.potential = SQUARE_WELL;
+            else if (potential == "lennard_jones") pair.potential = LENNARD_JONES;
+            else if (potential == "wca") pair.potential = WEEKS_CHANDLER_ANDERSEN;
+            else if (potential == "cos_squared") pair.potential = COS_SQUARED;
+            else
+            {
+                std::cerr << "[ERROR] MultiSpeciesModel: Unknown potential \"" << potential << "\"!\n";
+                exit(EXIT_FAILURE);
+            }
+
+            if ((type1 >= nTypes_) || (type2 >= nTypes_))
+            {
+                std::cerr << "[ERROR] MultiSpeciesModel: Particle type out of range!\n";
+                exit(EXIT_FAILURE);
+            }
+
+            // The table is symmetric.
+            parameters[type1*nTypes_ + type2] = pair;
+            parameters[type2*nTypes_ + type1] = pair;
+        }
+
+        if (!dataFile.eof())
+        {
+            std::cerr << "[ERROR] MultiSpeciesModel: Invalid parameter file!\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+    else
+    {
+        std::cerr << "[ERROR] MultiSpeciesModel: Invalid parameter file!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    // Close file stream.
+    dataFile.close();
+
+    setParameters(nTypes_, parameters);
+}
+
+#ifndef ISOTROPIC
+double MultiSpeciesModel::computePairEnergyFromDistance(unsigned int particle1, const double* position1, unsigned int type1,
+    const double* orientation1, unsigned int particle2, const double* position2, unsigned int type2,
+    const double* orientation2, double normSqd)
+#else
+double MultiSpeciesModel::computePairEnergyFromDistance(unsigned int particle1, const double* position1, unsigned int type1,
+    unsigned int particle2, const double* position2, unsigned int type2, double normSqd)
+#endif
+{
+    return lookup(normSqd, type1, type2);
+}
+
+double MultiSpeciesModel::lookup(double normSqd, unsigned int type1, unsigned int type2) const
+{
+    // The table is empty until the pair parameters are set.
+    if (coefficients.empty())
+    {
+        std::cerr << "[ERROR] MultiSpeciesModel: Pair parameters must be set before computing energies!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    assert((type1 < nTypes) && (type2 < nTypes));
+
+    const PairCoefficients& pair = coefficients[type1*nTypes + type2];
+
+    return pair.energy(normSqd, pair);
+}
+
+MultiSpeciesModel::PairCoefficients MultiSpeciesModel::compile(const PairParameters& parameters)
+{
+    PairCoefficients pair;
+
+    pair.epsilon = parameters.epsilon;
+    pair.sigma = parameters.sigma;
+    pair.squaredSigma = parameters.sigma*parameters.sigma;
+    pair.squaredCutOff = parameters.cutOff*parameters.cutOff;
+    pair.shift = 0;
+    pair.scale = 0;
+
+    switch (parameters.potential)
+    {
+        case NONE:
+            pair.energy = &computeNone;
+            break;
+
+        case HARD_SPHERE:
+            pair.energy = &computeHardSphere;
+            break;
+
+        case SQUARE_WELL:
+            pair.energy = &computeSquareWell;
+            break;
+
+        case LENNARD_JONES:
+        {
+            // Shift the potential to zero at the cut-off.
+            double r6Inv = std::pow(pair.squaredSigma / pair.squaredCutOff, 3);
+            pair.shift = 4.0*pair.epsilon*(r6Inv*r6Inv - r6Inv);
+            pair.energy = &computeLennardJones;
+            break;
+        }
+
+        case WEEKS_CHANDLER_ANDERSEN:
+            pair.energy = &computeWeeksChandlerAndersen;
+            break;
+
+        case COS_SQUARED:
+            // The well decays to zero over the interval [sigma, cutOff].
+            if (parameters.cutOff > parameters.sigma)
+                pair.scale = M_PI / (2*(parameters.cutOff - parameters.sigma));
+            pair.energy = &computeCosSquared;
+            break;
+    }
+
+    return pair;
+}
+
+double MultiSpeciesModel::computeNone(double normSqd, const PairCoefficients& pair)
+{
+    return 0;
+}
+
+double MultiSpeciesModel::computeHardSphere(double normSqd, const PairCoefficients& pair)
+{
+    if (normSqd < pair.squaredSigma) return INF;
+    return 0;
+}
+
+double MultiSpeciesModel::computeSquareWell(double normSqd, const PairCoefficients& pair)
+{
+    if (normSqd < pair.squaredSigma) return INF;
+    if (normSqd < pair.squaredCutOff) return -pair.epsilon;
+    return 0;
+}
+
+double MultiSpeciesModel::computeLennardJones(double normSqd, const PairCoefficients& pair)
+{
+    if (normSqd < pair.squaredCutOff)
+    {
+        double r2Inv = pair.squaredSigma / normSqd;
+        double r6Inv = r2Inv*r2Inv*r2Inv;
+        return 4.0*pair.epsilon*((r6Inv*r6Inv) - r6Inv) - pair.shift;
+    }
+    else return 0;
+}
+
+double MultiSpeciesModel::computeWeeksChandlerAndersen(double normSqd, const PairCoefficients& pair)
+{
+    if (normSqd < pair.squaredSigma)
+    {
+        double r2Inv = pair.squaredSigma / normSqd;
+        double r6Inv = r2Inv*r2Inv*r2Inv;
+        return pair.epsilon*((r6Inv*r6Inv) - 2*r6Inv + 1);
+    }
+    else return 0;
+}
+
+double MultiSpeciesModel::computeCosSquared(double normSqd, const PairCoefficients& pair)
+{
+    // Soft repulsive core.
+    if (normSqd < pair.squaredSigma) return computeWeeksChandlerAndersen(normSqd, pair);
+
+    if (normSqd < pair.squaredCutOff)
+    {
+        double cosineTerm = cos(pair.scale*(sqrt(normSqd) - pair.sigma));
+        return -pair.epsilon*cosineTerm*cosineTerm;
+    }
+    else return 0;
+}
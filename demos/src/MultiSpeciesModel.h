@@ -0,0 +1,210 @@
+/*
+  Copyright (c) 2015-2016 Lester Hedges <lester.hedges+vmmc@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _MULTISPECIESMODEL_H
+#define _MULTISPECIESMODEL_H
+
+#include <string>
+
+#include "StaticModel.h"
+
+/*! \file MultiSpeciesModel.h
+*/
+
+//! Class defining a mixture of particle species with type-pair potentials.
+/*! The potential form, energy scale, core diameter, and cut-off for each pair
+    of particle types are read from a table at run time. The table is compiled
+    into per-pair coefficients and a pointer to the radial energy function, so
+    each pair evaluation is a single indexed lookup rather than a chain of
+    type comparisons.
+ */
+class MultiSpeciesModel : public StaticModel<MultiSpeciesModel>
+{
+    friend class StaticModel<MultiSpeciesModel>;
+
+public:
+    //! Radial potential forms.
+    enum Potential
+    {
+        NONE,                       //!< No interaction.
+        HARD_SPHERE,                //!< Hard core of diameter sigma.
+        SQUARE_WELL,                //!< Hard core with a square well of depth epsilon.
+        LENNARD_JONES,              //!< Lennard-Jones, shifted to zero at the cut-off.
+        WEEKS_CHANDLER_ANDERSEN,    //!< Soft repulsive core, zero beyond sigma.
+        COS_SQUARED                 //!< Soft repulsive core with a cosine-squared well.
+    };
+
+    //! Parameters of the potential between a pair of particle types.
+    struct PairParameters
+    {
+        Potential potential;        //!< The potential form.
+        double epsilon;             //!< The energy scale (in units of kBT).
+        double sigma;               //!< The core diameter (in units of particle diameter).
+        double cutOff;              //!< The cut-off distance (in units of particle diameter).
+    };
+
+    //! Constructor.
+    /*! \param box_
+            A reference to the simulation box object.
+
+        \param particles_
+            A reference to the particle list.
+
+        \param cells_
+            A reference to the cell list object.
+
+        \param maxInteractions_
+            The maximum number of interactions per particle.
+
+        \param interactionEnergy_
+            The potential energy scale (in units of kBT).
+
+        \param interactionRange_
+            The potential cut-off distance, i.e. the largest cut-off of any pair of types.
+     */
+    MultiSpeciesModel(Box&, std::vector<Particle>&, CellList&, unsigned int, double, double);
+
+    //! Set the potential between each pair of particle types.
+    /*! The cut-offs are also passed to Model::setInteractionRanges, so that
+        neighbour queries only visit types that can interact. Pairs with a
+        core must have a cut-off of at least sigma. This must be called before
+        any energies are computed, and every particle type must be in the table.
+
+        \param nTypes_
+            The number of particle types.
+
+        \param parameters
+            The parameters for each pair of types (nTypes x nTypes, row major).
+     */
+    void setParameters(unsigned int, const std::vector<PairParameters>&);
+
+    //! Load the potential between each pair of particle types from file.
+    /*! Each line of the file contains "type1 type2 potential epsilon sigma cutOff",
+        where potential is one of none, hard_sphere, square_well, lennard_jones,
+        wca, or cos_squared. Pairs that aren't listed don't interact.
+
+        \param fileName
+            The name of the parameter file.
+
+        \param nTypes_
+            The number of particle types.
+     */
+    void loadParameters(std::string, unsigned int);
+
+protected:
+    //! Calculate the pair energy between two particles with a known separation.
+    /*! \param particle1
+            The index of the first particle.
+
+        \param position1
+            The position vector of the first particle.
+
+        \param type1
+            The type of the first particle.
+
+        \param orientation1
+            The orientation vector of the first particle.
+
+        \param particle2
+            The index of the second particle.
+
+        \param position2
+            The position vector of the second particle.
+
+        \param type2
+            The type of the second particle.
+
+        \param orientation2
+            The orientation vector of the second particle.
+
+        \param normSqd
+            The squared minimum image separation between the particles.
+
+        \return
+            The pair energy between particles 1 and 2.
+     */
+#ifndef ISOTROPIC
+    double computePairEnergyFromDistance(unsigned int, const double*, unsigned int, const double*,
+        unsigned int, const double*, unsigned int, const double*, double);
+#else
+    double computePairEnergyFromDistance(unsigned int, const double*, unsigned int,
+        unsigned int, const double*, unsigned int, double);
+#endif
+
+private:
+    struct PairCoefficients;
+
+    //! Radial energy function prototype.
+    /*! \param normSqd
+            The squared separation between the particles.
+
+        \param coefficients
+            The compiled coefficients for the pair of types.
+
+        \return
+            The pair energy.
+     */
+    typedef double (*RadialEnergy)(double, const PairCoefficients&);
+
+    //! Compiled potential between a pair of particle types.
+    struct PairCoefficients
+    {
+        RadialEnergy energy;        //!< The radial energy function.
+        double epsilon;             //!< The energy scale.
+        double sigma;               //!< The core diameter.
+        double squaredSigma;        //!< The squared core diameter.
+        double squaredCutOff;       //!< The squared cut-off distance.
+        double shift;               //!< Energy shift to zero the potential at the cut-off.
+        double scale;               //!< Scale factor for the cosine-squared well.
+    };
+
+    //! Compile the pair parameters into coefficients.
+    /*! \param parameters
+            The parameters for the pair of types.
+
+        \return
+            The compiled coefficients.
+     */
+    static PairCoefficients compile(const PairParameters&);
+
+    //! Radial energy functions for each potential form.
+    static double computeNone(double, const PairCoefficients&);
+    static double computeHardSphere(double, const PairCoefficients&);
+    static double computeSquareWell(double, const PairCoefficients&);
+    static double computeLennardJones(double, const PairCoefficients&);
+    static double computeWeeksChandlerAndersen(double, const PairCoefficients&);
+    static double computeCosSquared(double, const PairCoefficients&);
+
+    //! Look up the pair energy for a given squared separation.
+    /*! \param normSqd
+            The squared separation between the particles.
+
+        \param type1
+            The type of the first particle.
+
+        \param type2
+            The type of the second particle.
+
+        \return
+            The pair energy.
+     */
+    double lookup(double, unsigned int, unsigned int) const;
+
+    std::vector<PairCoefficients> coefficients;     //!< Compiled potential for each pair of types.
+};
+
+#endif  /* _MULTISPECIESMODEL_H */
@@ -32,6 +32,7 @@ public:
     Particle();
 
     unsigned int index;                 //!< Particle index.
+    unsigned int id;                    //!< External particle index (unchanged by reordering).
     unsigned int type;                  //!< Particle type.
     std::vector<double> position;       //!< The x,y,z coordinates of the particle.
     std::vector<double> orientation;    //!< The orientation of the particle (unit vector).
@@ -15,9 +15,11 @@
   along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <iostream>
+#include <limits>
 
 #include "Box.h"
 #include "CellList.h"
@@ -35,7 +37,7 @@ PatchyDisc::PatchyDisc(
     unsigned int maxInteractions_,
     double interactionEnergy_,
     double interactionRange_) :
-    Model(box_, particles_, cells_, maxInteractions_, interactionEnergy_, interactionRange_)
+    StaticModel<PatchyDisc>(box_, particles_, cells_, maxInteractions_, interactionEnergy_, interactionRange_)
 {
 #ifdef ISOTROPIC
     std::cerr << "[ERROR] PatchyDisc: Cannot be used with isotropic VMMC library!\n";
@@ -62,63 +64,108 @@ PatchyDisc::PatchyDisc(
         cosTheta[i] = cos(i*patchSeparation);
         sinTheta[i] = sin(i*patchSeparation);
     }
+
+    // Patches sit on the disc surface, so a patch can only interact with one on
+    // the partner if it lies within this distance of the partner's centre.
+    squaredPrefilterRange = (0.5 + interactionRange)*(0.5 + interactionRange);
+
+    // Allocate the patch cache. Entries are filled as they are first used,
+    // so start with an orientation that can never match.
+    cacheStride = 2 + 2*maxInteractions;
+    patchCache = std::make_shared<std::vector<double> >(cacheStride*particles.size(),
+        std::numeric_limits<double>::quiet_NaN());
+
+    // Allocate scratch space for patch positions and facing patches.
+    scratch1.resize(2*maxInteractions);
+    scratch2.resize(2*maxInteractions);
+    candidates1.resize(maxInteractions);
+    candidates2.resize(maxInteractions);
 }
 
 double PatchyDisc::computePairEnergy(unsigned int particle1, const double* position1,
     const double* orientation1, unsigned int particle2, const double* position2, const double* orientation2)
 {
-    // Separation vector.
-    std::vector<double> sep(2);
-
-    // Calculate disc separation.
-    sep[0] = position1[0] - position2[0];
-    sep[1] = position1[1] - position2[1];
+    // Squared minimum image separation of the discs.
+    double normSqd = box.computeSquaredDistance(position1, position2);
 
-    // Enforce minimum image.
-    box.minimumImage(sep);
+    return computePatchEnergy(particle1, position1, orientation1, particle2, position2, orientation2, normSqd);
+}
 
-    // Calculate squared norm of vector.
-    double normSqd = sep[0]*sep[0] + sep[1]*sep[1];
+#ifndef ISOTROPIC
+double PatchyDisc::computePairEnergyFromDistance(unsigned int particle1, const double* position1, unsigned int type1,
+    const double* orientation1, unsigned int particle2, const double* position2, unsigned int type2,
+    const double* orientation2, double normSqd)
+{
+    return computePatchEnergy(particle1, position1, orientation1, particle2, position2, orientation2, normSqd);
+}
+#else
+double PatchyDisc::computePairEnergyFromDistance(unsigned int particle1, const double* position1, unsigned int type1,
+    unsigned int particle2, const double* position2, unsigned int type2, double normSqd)
+{
+    // Patches need orientations, so only the hard core is defined (the model
+    // can't be constructed in an isotropic build anyway).
+    if (normSqd < 1) return INF;
+    return 0;
+}
+#endif
 
+double PatchyDisc::computePatchEnergy(unsigned int particle1, const double* position1, const double* orientation1,
+    unsigned int particle2, const double* position2, const double* orientation2, double normSqd)
+{
     // Discs overlap.
     if (normSqd < 1) return INF;
 
-    // Total interaction energy sum.
-    double energy = 0;
+    // Patch positions of both discs, relative to their centres.
+    const double* patches1 = getPatches(particle1, orientation1, &scratch1[0]);
+    const double* patches2 = getPatches(particle2, orientation2, &scratch2[0]);
+
+    // Minimum image separation of the disc centres (from disc 1 to disc 2).
+    double sep[2];
+    box.computeSeparation(position2, position1, sep);
+
+    // A patch on disc 1 can only interact if it faces disc 2, i.e. it lies
+    // within the prefilter range of the centre of disc 2, and vice versa.
+    // For a patch at d, |sep - d|^2 < range^2 reduces to sep.d > threshold.
+    double threshold = 0.5*(normSqd + 0.25 - squaredPrefilterRange);
+
+    unsigned int nCandidates1 = 0;
+    unsigned int nCandidates2 = 0;
 
-    // Test interactions between all patch pairs.
     for (unsigned int i=0;i<maxInteractions;i++)
     {
-        // Compute position of patch i on first disc.
-        std::vector<double> coord1(2);
-        coord1[0] = position1[0] + 0.5*(orientation1[0]*cosTheta[i] - orientation1[1]*sinTheta[i]);
-        coord1[1] = position1[1] + 0.5*(orientation1[0]*sinTheta[i] + orientation1[1]*cosTheta[i]);
+        const double* patch = patches1 + 2*i;
+        if (sep[0]*patch[0] + sep[1]*patch[1] > threshold)
+            candidates1[nCandidates1++] = i;
+    }
 
-        // Enforce periodic boundaries.
-        box.periodicBoundaries(coord1);
+    // No patches face disc 2.
+    if (nCandidates1 == 0) return 0;
 
-        for (unsigned int j=0;j<maxInteractions;j++)
-        {
-            // Compute position of patch j on second disc.
-            std::vector<double> coord2(2);
-            coord2[0] = position2[0] + 0.5*(orientation2[0]*cosTheta[j] - orientation2[1]*sinTheta[j]);
-            coord2[1] = position2[1] + 0.5*(orientation2[0]*sinTheta[j] + orientation2[1]*cosTheta[j]);
+    for (unsigned int i=0;i<maxInteractions;i++)
+    {
+        const double* patch = patches2 + 2*i;
+        if (sep[0]*patch[0] + sep[1]*patch[1] < -threshold)
+            candidates2[nCandidates2++] = i;
+    }
 
-            // Enforce periodic boundaries.
-            box.periodicBoundaries(coord2);
+    // Total interaction energy sum.
+    double energy = 0;
 
-            // Calculate patch separation.
-            sep[0] = coord1[0] - coord2[0];
-            sep[1] = coord1[1] - coord2[1];
+    // Test interactions between facing patch pairs.
+    for (unsigned int i=0;i<nCandidates1;i++)
+    {
+        const double* patch1 = patches1 + 2*candidates1[i];
 
-            // Enforce minimum image.
-            box.minimumImage(sep);
+        for (unsigned int j=0;j<nCandidates2;j++)
+        {
+            const double* patch2 = patches2 + 2*candidates2[j];
 
-            // Calculate squared norm of vector.
-            normSqd = sep[0]*sep[0] + sep[1]*sep[1];
+            // Separation of the patches.
+            double x = sep[0] + patch2[0] - patch1[0];
+            double y = sep[1] + patch2[1] - patch1[1];
 
             // Patches interact.
-            if (normSqd < squaredCutOffDistance)
+            if ((x*x + y*y) < squaredCutOffDistance)
                 energy -= interactionEnergy;
         }
     }
@@ -126,23 +173,99 @@ double PatchyDisc::computePairEnergy(unsigned int particle1, const double* posit
     return energy;
 }
 
+void PatchyDisc::computePatches(const double* orientation, double* patches) const
+{
+    for (unsigned int i=0;i<maxInteractions;i++)
+    {
+        patches[2*i]   = 0.5*(orientation[0]*cosTheta[i] - orientation[1]*sinTheta[i]);
+        patches[2*i+1] = 0.5*(orientation[0]*sinTheta[i] + orientation[1]*cosTheta[i]);
+    }
+}
+
+const double* PatchyDisc::getPatches(unsigned int particle, const double* orientation, double* patches)
+{
+    double* entry = &(*patchCache)[cacheStride*particle];
+
+    // Cache hit.
+    if ((entry[0] == orientation[0]) && (entry[1] == orientation[1])) return entry + 2;
+
+#ifndef ISOTROPIC
+    // This is the stored orientation of the disc, so refresh the cache entry.
+    if ((orientation[0] == particles[particle].orientation[0])
+        && (orientation[1] == particles[particle].orientation[1]))
+    {
+        updatePatches(particle);
+        return entry + 2;
+    }
+#endif
+
+    // Trial orientation.
+    computePatches(orientation, patches);
+
+    return patches;
+}
+
+void PatchyDisc::updatePatches(unsigned int particle)
+{
+#ifndef ISOTROPIC
+    double* entry = &(*patchCache)[cacheStride*particle];
+
+    entry[0] = particles[particle].orientation[0];
+    entry[1] = particles[particle].orientation[1];
+
+    computePatches(entry, entry + 2);
+#endif
+}
+
+#ifndef ISOTROPIC
+void PatchyDisc::applyPostMoveUpdates(unsigned int particle, const double* position, const double* orientation)
+{
+    StaticModel<PatchyDisc>::applyPostMoveUpdates(particle, position, orientation);
+
+    // Refresh the patch positions for the new orientation.
+    updatePatches(particle);
+}
+#endif
+
+void PatchyDisc::reorder(const unsigned int* order)
+{
+    StaticModel<PatchyDisc>::reorder(order);
+
+    // Permute the patch cache to match.
+    std::vector<double> newCache(patchCache->size());
+
+    for (unsigned int i=0;i<particles.size();i++)
+    {
+        std::copy(patchCache->begin() + cacheStride*order[i],
+            patchCache->begin() + cacheStride*(order[i] + 1), newCache.begin() + cacheStride*i);
+    }
+
+    patchCache->swap(newCache);
+}
+
 unsigned int PatchyDisc::computeInteractions(unsigned int particle,
     const double* position, const double* orientation, unsigned int* interactions)
 {
     // Interaction counter.
     unsigned int nInteractions = 0;
 
-    // Check all neighbouring cells including same cell.
-    for (unsigned int i=0;i<cells.getNeighbours();i++)
+    // Bring the Verlet lists up to date following any moves.
+    cells.refreshNeighbourLists(particles);
+
+    // Check all blocks of candidate neighbours, i.e. the neighbouring cells
+    // (including same cell), or the particle's Verlet list.
+    unsigned int nBlocks = cells.getNeighbourBlocks(particles[particle]);
+
+    for (unsigned int i=0;i<nBlocks;i++)
     {
-        // Cell index.
-        unsigned int cell = cells[particles[particle].cell].neighbours[i];
+        const unsigned int* blockParticles;
+        unsigned int tally = cells.getNeighbourBlock(particles[particle], i, blockParticles);
 
-        // Check all particles within cell.
-        for (unsigned int j=0;j<cells[cell].tally;j++)
+        // Check all particles within block.
+        for (unsigned int j=0;j<tally;j++)
         {
             // Index of neighbouring particle.
-            unsigned int neighbour = cells[cell].particles[j];
+            unsigned int neighbour = blockParticles[j];
 
             // Make sure the particles are different.
             if (neighbour != particle)
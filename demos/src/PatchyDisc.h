@@ -18,15 +18,21 @@
 #ifndef _PATCHYDISC_H
 #define _PATCHYDISC_H
 
-#include "Model.h"
+#include <memory>
+
+#include "StaticModel.h"
 
 /*! \file PatchyDisc.h
 */
 
 //! Class defining the Patchy-Disc potential.
-class PatchyDisc : public Model
+class PatchyDisc : public StaticModel<PatchyDisc>
 {
+    friend class StaticModel<PatchyDisc>;
+
 public:
+    using StaticModel<PatchyDisc>::computePairEnergy;
+
     //! Constructor.
     /*! \param box_
             A reference to the simulation box object.
@@ -90,10 +96,140 @@ public:
      */
     unsigned int computeInteractions(unsigned int, const double*, const double*, unsigned int*);
 
+#ifndef ISOTROPIC
+    //! Apply any post-move updates, e.g. update cell lists, or neighbour lists.
+    /*! \param particle
+            The index of the particle that moved.
+
+        \param position
+            The position of the particle following the virtual move.
+
+        \param orientation
+            The orientation of the particle following the virtual move.
+     */
+    void applyPostMoveUpdates(unsigned int, const double*, const double*);
+#endif
+
+    //! Apply a new particle ordering, e.g. following a call to VMMC::reorder.
+    /*! \param order
+            The old index of the particle at each new position.
+     */
+    void reorder(const unsigned int*);
+
+protected:
+    //! Calculate the pair energy between two particles with a known separation.
+    /*! \param particle1
+            The index of the first particle.
+
+        \param position1
+            The position vector of the first particle.
+
+        \param type1
+            The type of the first particle.
+
+        \param orientation1
+            The orientation vector of the first particle.
+
+        \param particle2
+            The index of the second particle.
+
+        \param position2
+            The position vector of the second particle.
+
+        \param type2
+            The type of the second particle.
+
+        \param orientation2
+            The orientation vector of the second particle.
+
+        \param normSqd
+            The squared minimum image separation between the particles.
+
+        \return
+            The pair energy between particles 1 and 2.
+     */
+#ifndef ISOTROPIC
+    double computePairEnergyFromDistance(unsigned int, const double*, unsigned int, const double*,
+        unsigned int, const double*, unsigned int, const double*, double);
+#else
+    double computePairEnergyFromDistance(unsigned int, const double*, unsigned int,
+        unsigned int, const double*, unsigned int, double);
+#endif
+
 private:
+    //! Calculate the patch interaction energy between two discs.
+    /*! \param position1
+            The position vector of the first disc.
+
+        \param orientation1
+            The orientation vector of the first disc.
+
+        \param position2
+            The position vector of the second disc.
+
+        \param orientation2
+            The orientation vector of the second disc.
+
+        \param normSqd
+            The squared minimum image separation between the discs.
+
+        \return
+            The pair energy between the discs.
+     */
+    double computePatchEnergy(unsigned int, const double*, const double*,
+        unsigned int, const double*, const double*, double);
+
+    //! Compute the patch positions of a disc, relative to its centre.
+    /*! \param orientation
+            The orientation vector of the disc.
+
+        \param patches
+            Array to store the patch positions (two entries per patch).
+     */
+    void computePatches(const double*, double*) const;
+
+    //! Get the patch positions of a disc, relative to its centre.
+    /*! Cached positions are returned if the orientation matches that of the
+        cache entry. The entry is refreshed if the orientation is the stored
+        orientation of the disc, otherwise the positions are computed into
+        the scratch array, e.g. for a trial orientation.
+
+        \param particle
+            The index of the disc.
+
+        \param orientation
+            The orientation vector of the disc.
+
+        \param patches
+            Scratch array for the patch positions (two entries per patch).
+
+        \return
+            A pointer to the patch positions.
+     */
+    const double* getPatches(unsigned int, const double*, double*);
+
+    //! Refresh the cached patch positions of a disc from its stored orientation.
+    /*! \param particle
+            The index of the disc.
+     */
+    void updatePatches(unsigned int);
+
     double patchSeparation;         //!< The angle between patches in radians.
     std::vector<double> cosTheta;   //!< Lookup table for cosine rotation matrix components.
     std::vector<double> sinTheta;   //!< Lookup table for sine rotation matrix components.
+
+    /// Cached patch positions, relative to the disc centre. Each entry holds the
+    /// orientation the positions were computed for, followed by the positions.
+    /// The cache is shared, since callbacks are typically bound to copies of the model.
+    std::shared_ptr<std::vector<double> > patchCache;
+
+    unsigned int cacheStride;       //!< The size of a patch cache entry.
+    double squaredPrefilterRange;   //!< Squared distance from a disc centre within which a partner patch must lie.
+
+    std::vector<double> scratch1;           //!< Patch positions of the first disc for a trial orientation.
+    std::vector<double> scratch2;           //!< Patch positions of the second disc for a trial orientation.
+    std::vector<unsigned int> candidates1;  //!< Patches of the first disc that face the second.
+    std::vector<unsigned int> candidates2;  //!< Patches of the second disc that face the first.
 };
 
 #endif  /* _PATCHYDISC_H */
@@ -0,0 +1,231 @@
+/*
+  Copyright (c) 2015-2016 Lester Hedges <lester.hedges+vmmc@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SIMD_H
+#define _SIMD_H
+
+#include <cmath>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+
+/*! \file Simd.h
+    \brief Minimal wrappers for packed double precision arithmetic.
+
+    The vector width is chosen at compile time: AVX-512 (8 lanes) or AVX2
+    (4 lanes) when enabled, e.g. with OPTFLAGS=-march=native, otherwise a
+    scalar fallback (1 lane). Kernels written with these wrappers compile
+    unchanged for each instruction set.
+*/
+
+namespace simd
+{
+#if defined(__AVX512F__)
+
+    const unsigned int WIDTH = 8;                   //!< Number of lanes per vector.
+
+    //! Packed doubles.
+    struct Double { __m512d v; };
+
+    //! Packed comparison result.
+    struct Mask { __mmask8 m; };
+
+    inline Double set(double a) { Double r = {_mm512_set1_pd(a)}; return r; }
+    inline Double load(const double* p) { Double r = {_mm512_loadu_pd(p)}; return r; }
+    inline void store(double* p, Double a) { _mm512_storeu_pd(p, a.v); }
+
+    //! Load unsigned integers (e.g. particle types) and convert to doubles.
+    inline Double load(const unsigned int* p)
+    {
+        Double r = {_mm512_cvtepu32_pd(_mm256_loadu_si256((const __m256i*) p))};
+        return r;
+    }
+
+    inline Double operator + (Double a, Double b) { Double r = {_mm512_add_pd(a.v, b.v)}; return r; }
+    inline Double operator - (Double a, Double b) { Double r = {_mm512_sub_pd(a.v, b.v)}; return r; }
+    inline Double operator * (Double a, Double b) { Double r = {_mm512_mul_pd(a.v, b.v)}; return r; }
+    inline Double operator / (Double a, Double b) { Double r = {_mm512_div_pd(a.v, b.v)}; return r; }
+
+    //! Round to the nearest integer (ties to even, as std::rint).
+    inline Double rint(Double a)
+    {
+        Double r = {_mm512_roundscale_pd(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)};
+        return r;
+    }
+
+    inline Double sqrt(Double a) { Double r = {_mm512_sqrt_pd(a.v)}; return r; }
+
+    inline Mask operator < (Double a, Double b) { Mask r = {_mm512_cmp_pd_mask(a.v, b.v, _CMP_LT_OQ)}; return r; }
+    inline Mask operator == (Double a, Double b) { Mask r = {_mm512_cmp_pd_mask(a.v, b.v, _CMP_EQ_OQ)}; return r; }
+    inline Mask operator & (Mask a, Mask b) { Mask r = {(__mmask8) (a.m & b.m)}; return r; }
+
+    //! Select lanes of a where the mask is set, and of b elsewhere.
+    inline Double select(Mask m, Double a, Double b) { Double r = {_mm512_mask_blend_pd(m.m, b.v, a.v)}; return r; }
+
+#elif defined(__AVX2__)
+
+    const unsigned int WIDTH = 4;                   //!< Number of lanes per vector.
+
+    //! Packed doubles.
+    struct Double { __m256d v; };
+
+    //! Packed comparison result.
+    struct Mask { __m256d m; };
+
+    inline Double set(double a) { Double r = {_mm256_set1_pd(a)}; return r; }
+    inline Double load(const double* p) { Double r = {_mm256_loadu_pd(p)}; return r; }
+    inline void store(double* p, Double a) { _mm256_storeu_pd(p, a.v); }
+
+    //! Load unsigned integers (e.g. particle types) and convert to doubles.
+    inline Double load(const unsigned int* p)
+    {
+        Double r = {_mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*) p))};
+        return r;
+    }
+
+    inline Double operator + (Double a, Double b) { Double r = {_mm256_add_pd(a.v, b.v)}; return r; }
+    inline Double operator - (Double a, Double b) { Double r = {_mm256_sub_pd(a.v, b.v)}; return r; }
+    inline Double operator * (Double a, Double b) { Double r = {_mm256_mul_pd(a.v, b.v)}; return r; }
+    inline Double operator / (Double a, Double b) { Double r = {_mm256_div_pd(a.v, b.v)}; return r; }
+
+    //! Round to the nearest integer (ties to even, as std::rint).
+    inline Double rint(Double a)
+    {
+        Double r = {_mm256_round_pd(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)};
+        return r;
+    }
+
+    inline Double sqrt(Double a) { Double r = {_mm256_sqrt_pd(a.v)}; return r; }
+
+    inline Mask operator < (Double a, Double b) { Mask r = {_mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ)}; return r; }
+    inline Mask operator == (Double a, Double b) { Mask r = {_mm256_cmp_pd(a.v, b.v, _CMP_EQ_OQ)}; return r; }
+    inline Mask operator & (Mask a, Mask b) { Mask r = {_mm256_and_pd(a.m, b.m)}; return r; }
+
+    //! Select lanes of a where the mask is set, and of b elsewhere.
+    inline Double select(Mask m, Double a, Double b) { Double r = {_mm256_blendv_pd(b.v, a.v, m.m)}; return r; }
+
+#else
+
+    const unsigned int WIDTH = 1;                   //!< Number of lanes per vector.
+
+    //! Packed doubles.
+    struct Double { double v; };
+
+    //! Packed comparison result.
+    struct Mask { bool m; };
+
+    inline Double set(double a) { Double r = {a}; return r; }
+    inline Double load(const double* p) { Double r = {*p}; return r; }
+    inline void store(double* p, Double a) { *p = a.v; }
+
+    //! Load unsigned integers (e.g. particle types) and convert to doubles.
+    inline Double load(const unsigned int* p) { Double r = {(double) *p}; return r; }
+
+    inline Double operator + (Double a, Double b) { Double r = {a.v + b.v}; return r; }
+    inline Double operator - (Double a, Double b) { Double r = {a.v - b.v}; return r; }
+    inline Double operator * (Double a, Double b) { Double r = {a.v * b.v}; return r; }
+    inline Double operator / (Double a, Double b) { Double r = {a.v / b.v}; return r; }
+
+    //! Round to the nearest integer (ties to even, as std::rint).
+    inline Double rint(Double a) { Double r = {std::rint(a.v)}; return r; }
+
+    inline Double sqrt(Double a) { Double r = {std::sqrt(a.v)}; return r; }
+
+    inline Mask operator < (Double a, Double b) { Mask r = {a.v < b.v}; return r; }
+    inline Mask operator == (Double a, Double b) { Mask r = {a.v == b.v}; return r; }
+    inline Mask operator & (Mask a, Mask b) { Mask r = {a.m && b.m}; return r; }
+
+    //! Select lanes of a where the mask is set, and of b elsewhere.
+    inline Double select(Mask m, Double a, Double b) { return m.m ? a : b; }
+
+#endif
+
+    //! Cosine for arguments in the range [-pi/2, pi/2].
+    /*! Evaluates the Taylor series to twentieth order, which is accurate
+        to double precision across the range.
+
+        \param x
+            The argument.
+
+        \return
+            The cosine of the argument.
+     */
+    inline Double cos(Double x)
+    {
+        Double y = x*x;
+
+        // Coefficients (-1)^k / (2k)!, highest order first.
+        static const double coefficients[11] =
+        {
+            1.0/2432902008176640000.0, -1.0/6402373705728000.0, 1.0/20922789888000.0,
+            -1.0/87178291200.0, 1.0/479001600.0, -1.0/3628800.0, 1.0/40320.0,
+            -1.0/720.0, 1.0/24.0, -1.0/2.0, 1.0
+        };
+
+        Double sum = set(coefficients[0]);
+        for (unsigned int i=1;i<11;i++)
+            sum = sum*y + set(coefficients[i]);
+
+        return sum;
+    }
+
+    //! Squared minimum image distance from a point to packed coordinates.
+    /*! The minimum image is applied without branches, via rint. Pass an
+        inverse box size of zero for non-periodic axes.
+
+        \param position
+            The coordinates of the point.
+
+        \param coordinates
+            The packed coordinates, stored axis by axis.
+
+        \param stride
+            The number of packed coordinates per axis.
+
+        \param offset
+            The index of the first lane.
+
+        \param boxSize
+            The size of the simulation box along each axis.
+
+        \param inverseBoxSize
+            The inverse box size along each axis (zero if not periodic).
+
+        \param dimension
+            The dimension of the simulation box.
+
+        \return
+            The squared distances.
+     */
+    inline Double squaredDistance(const double* position, const double* coordinates, unsigned int stride, unsigned int offset,
+        const double* boxSize, const double* inverseBoxSize, unsigned int dimension)
+    {
+        Double normSqd = set(0);
+
+        for (unsigned int i=0;i<dimension;i++)
+        {
+            Double sep = load(coordinates + i*stride + offset) - set(position[i]);
+            sep = sep - set(boxSize[i])*rint(sep*set(inverseBoxSize[i]));
+            normSqd = normSqd + sep*sep;
+        }
+
+        return normSqd;
+    }
+}
+
+#endif  /* _SIMD_H */
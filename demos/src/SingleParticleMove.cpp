@@ -80,15 +80,9 @@ void SingleParticleMove::step()
             // Increment number of rotations.
             nRotations += moveParams.isRotation;
 
-            unsigned int oldCell = moveParams.preMoveParticle.cell;
-            unsigned int newCell = model->particles[moveParams.seed].cell;
-
-            // update cell list
-            if (oldCell != newCell)
-            {
-                model->particles[moveParams.seed].cell = oldCell;
-                model->cells.updateCell(newCell, model->particles[moveParams.seed], model->particles);
-            }
+            // update cell list (and any neighbour lists)
+            model->particles[moveParams.seed].cell = moveParams.preMoveParticle.cell;
+            model->cells.updateParticle(model->particles[moveParams.seed], model->particles);
         }
     }
     else
@@ -18,6 +18,7 @@
 #include "Box.h"
 #include "CellList.h"
 #include "Particle.h"
+#include "Simd.h"
 #include "SquareWellium.h"
 
 SquareWellium::SquareWellium(
@@ -27,35 +28,49 @@ SquareWellium::SquareWellium(
     unsigned int maxInteractions_,
     double interactionEnergy_,
     double interactionRange_) :
-    Model(box_, particles_, cells_, maxInteractions_, interactionEnergy_, interactionRange_)
+    StaticModel<SquareWellium>(box_, particles_, cells_, maxInteractions_, interactionEnergy_, interactionRange_)
 {
 }
 
 #ifndef ISOTROPIC
-double SquareWellium::computePairEnergy(const unsigned int particle1, const double* position1, const unsigned int type1,
-    const double* orientation1, const unsigned int particle2, const double* position2,const unsigned int type2, const double* orientation2)
+double SquareWellium::computePairEnergyFromDistance(unsigned int particle1, const double* position1, unsigned int type1,
+    const double* orientation1, unsigned int particle2, const double* position2, unsigned int type2,
+    const double* orientation2, double normSqd)
 #else
-double SquareWellium::computePairEnergy(const unsigned int particle1,
-    const double* position1, const unsigned int type1, const unsigned int particle2, const double* position2, const unsigned int type2)
+double SquareWellium::computePairEnergyFromDistance(unsigned int particle1, const double* position1, unsigned int type1,
+    unsigned int particle2, const double* position2, unsigned int type2, double normSqd)
 #endif
 {
-    // Separation vector.
-    std::vector<double> sep(box.dimension);
+    if (normSqd < 1) return INF;
+    if (normSqd < squaredCutOffDistance) return -interactionEnergy;
+    return 0;
+}
 
-    // Calculate separation.
-    for (unsigned int i=0;i<box.dimension;i++)
-        sep[i] = position1[i] - position2[i];
+#ifndef ISOTROPIC
+void SquareWellium::computeBatchEnergies(unsigned int particle, const double* position, unsigned int type,
+    const double* orientation, NeighbourBatch& batch)
+#else
+void SquareWellium::computeBatchEnergies(unsigned int particle, const double* position, unsigned int type,
+    NeighbourBatch& batch)
+#endif
+{
+    const double* inverseBoxSize = &box.getInverseBoxSize()[0];
 
-    // Enforce minimum image.
-    box.minimumImage(sep);
+    simd::Double zero = simd::set(0);
+    simd::Double one = simd::set(1.0);
+    simd::Double overlap = simd::set(INF);
+    simd::Double well = simd::set(-interactionEnergy);
+    simd::Double cutOff = simd::set(squaredCutOffDistance);
 
-    double normSqd = 0;
+    // Process whole vectors (the batch capacity is padded to the SIMD width).
+    for (unsigned int i=0;i<batch.size;i+=simd::WIDTH)
+    {
+        simd::Double normSqd = simd::squaredDistance(position, &batch.coordinates[0],
+            batch.capacity, i, &box.boxSize[0], inverseBoxSize, box.dimension);
 
-    // Calculate squared norm of vector.
-    for (unsigned int i=0;i<box.dimension;i++)
-        normSqd += sep[i]*sep[i];
+        simd::Double energy = simd::select(normSqd < cutOff, well, zero);
 
-    if (normSqd < 1) return INF;
-    if (normSqd < squaredCutOffDistance) return -interactionEnergy;
-    return 0;
+        simd::store(&batch.energies[i], simd::select(normSqd < one, overlap, energy));
+        simd::store(&batch.squaredDistances[i], normSqd);
+    }
 }
@@ -18,14 +18,16 @@
 #ifndef _SQUAREWELLIUM_H
 #define _SQUAREWELLIUM_H
 
-#include "Model.h"
+#include "StaticModel.h"
 
 /*! \file SquareWellium.h
 */
 
 //! Class defining the square-well potential.
-class SquareWellium : public Model
+class SquareWellium : public StaticModel<SquareWellium>
 {
+    friend class StaticModel<SquareWellium>;
+
 public:
     //! Constructor.
     /*! \param box_
@@ -48,13 +50,17 @@ public:
      */
     SquareWellium(Box&, std::vector<Particle>&, CellList&, unsigned int, double, double);
 
-    //! Calculate the pair energy between two particles.
+protected:
+    //! Calculate the pair energy between two particles with a known separation.
     /*! \param particle1
             The index of the first particle.
 
         \param position1
             The position vector of the first particle.
 
+        \param type1
+            The type of the first particle.
+
         \param orientation1
             The orientation vector of the first particle.
 
@@ -64,16 +70,46 @@ public:
         \param position2
             The position vector of the second particle.
 
+        \param type2
+            The type of the second particle.
+
         \param orientation2
             The orientation vector of the second particle.
 
+        \param normSqd
+            The squared minimum image separation between the particles.
+
         \return
             The pair energy between particles 1 and 2.
      */
 #ifndef ISOTROPIC
-    double computePairEnergy(unsigned int, const double*, unsigned int, const double*, unsigned int, const double*, unsigned int,const double*);
+    double computePairEnergyFromDistance(unsigned int, const double*, unsigned int, const double*,
+        unsigned int, const double*, unsigned int, const double*, double);
+#else
+    double computePairEnergyFromDistance(unsigned int, const double*, unsigned int,
+        unsigned int, const double*, unsigned int, double);
+#endif
+
+    //! Calculate pair energies with a batch of packed neighbours, using SIMD.
+    /*! \param particle
+            The index of the particle.
+
+        \param position
+            The position vector of the particle.
+
+        \param type
+            The type of the particle.
+
+        \param orientation
+            The orientation vector of the particle.
+
+        \param batch
+            The packed neighbours.
+     */
+#ifndef ISOTROPIC
+    void computeBatchEnergies(unsigned int, const double*, unsigned int, const double*, NeighbourBatch&);
 #else
-    double computePairEnergy(unsigned int, const double*, unsigned int, unsigned int, const double*, unsigned int);
+    void computeBatchEnergies(unsigned int, const double*, unsigned int, NeighbourBatch&);
 #endif
 };
 
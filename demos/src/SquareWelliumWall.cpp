@@ -29,36 +29,21 @@ SquareWelliumWall::SquareWelliumWall(
     double interactionRange_,
     double wallInteractionEnergy_,
     double wallInteractionRange_) :
-    Model(box_, particles_, cells_, maxInteractions_, interactionEnergy_, interactionRange_),
+    StaticModel<SquareWelliumWall>(box_, particles_, cells_, maxInteractions_, interactionEnergy_, interactionRange_),
     wallInteractionEnergy(wallInteractionEnergy_),
     wallInteractionRange(wallInteractionRange_)
 {
 }
 
 #ifndef ISOTROPIC
-double SquareWelliumWall::computePairEnergy(const unsigned int particle1, const double* position1, const unsigned int type1,
-    const double* orientation1, const unsigned int particle2, const double* position2,const unsigned int type2, const double* orientation2)
+double SquareWelliumWall::computePairEnergyFromDistance(unsigned int particle1, const double* position1, unsigned int type1,
+    const double* orientation1, unsigned int particle2, const double* position2, unsigned int type2,
+    const double* orientation2, double normSqd)
 #else
-double SquareWelliumWall::computePairEnergy(const unsigned int particle1,
-    const double* position1, const unsigned int type1, const unsigned int particle2, const double* position2, const unsigned int type2)
+double SquareWelliumWall::computePairEnergyFromDistance(unsigned int particle1, const double* position1, unsigned int type1,
+    unsigned int particle2, const double* position2, unsigned int type2, double normSqd)
 #endif
 {
-    // Separation vector.
-    std::vector<double> sep(box.dimension);
-
-    // Calculate separation.
-    for (unsigned int i=0;i<box.dimension;i++)
-        sep[i] = position1[i] - position2[i];
-
-    // Enforce minimum image.
-    box.minimumImage(sep);
-
-    double normSqd = 0;
-
-    // Calculate squared norm of vector.
-    for (unsigned int i=0;i<box.dimension;i++)
-        normSqd += sep[i]*sep[i];
-
     if (normSqd < 1) return INF;
     if (normSqd < squaredCutOffDistance) return -interactionEnergy;
     return 0;
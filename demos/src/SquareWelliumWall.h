@@ -18,7 +18,7 @@
 #ifndef _SQUAREWELLIUMWALL_H
 #define _SQUAREWELLIUMWALL_H
 
-#include "Model.h"
+#include "StaticModel.h"
 
 /*! \file SquareWelliumWall.h
 */
@@ -29,8 +29,10 @@
     i.e. half a particle diameter. The wall is in the y dimension in 2D,
     and the z dimension in 3D.
  */
-class SquareWelliumWall : public Model
+class SquareWelliumWall : public StaticModel<SquareWelliumWall>
 {
+    friend class StaticModel<SquareWelliumWall>;
+
 public:
     //! Constructor.
     /*! \param box_
@@ -59,34 +61,6 @@ public:
      */
     SquareWelliumWall(Box&, std::vector<Particle>&, CellList&, unsigned int, double, double, double, double);
 
-    //! Calculate the pair energy between two particles.
-    /*! \param particle1
-            The index of the first particle.
-
-        \param position1
-            The position vector of the first particle.
-
-        \param orientation1
-            The orientation vector of the first particle.
-
-        \param particle2
-            The index of the second particle.
-
-        \param position2
-            The position vector of the second particle.
-
-        \param orientation2
-            The orientation vector of the second particle.
-
-        \return
-            The pair energy between particles 1 and 2.
-     */
-#ifndef ISOTROPIC
-    double computePairEnergy(unsigned int, const double*, unsigned int, const double*, unsigned int, const double*, unsigned int,const double*);
-#else
-    double computePairEnergy(unsigned int, const double*, unsigned int, unsigned int, const double*, unsigned int);
-#endif
-
     //! Calculate the interaction energy between a particle and the wall.
     /*! \param particle
             The index of the particle.
@@ -125,6 +99,46 @@ public:
     bool isOutsideBoundary(unsigned int, const double*);
 #endif
 
+protected:
+    //! Calculate the pair energy between two particles with a known separation.
+    /*! \param particle1
+            The index of the first particle.
+
+        \param position1
+            The position vector of the first particle.
+
+        \param type1
+            The type of the first particle.
+
+        \param orientation1
+            The orientation vector of the first particle.
+
+        \param particle2
+            The index of the second particle.
+
+        \param position2
+            The position vector of the second particle.
+
+        \param type2
+            The type of the second particle.
+
+        \param orientation2
+            The orientation vector of the second particle.
+
+        \param normSqd
+            The squared minimum image separation between the particles.
+
+        \return
+            The pair energy between particles 1 and 2.
+     */
+#ifndef ISOTROPIC
+    double computePairEnergyFromDistance(unsigned int, const double*, unsigned int, const double*,
+        unsigned int, const double*, unsigned int, const double*, double);
+#else
+    double computePairEnergyFromDistance(unsigned int, const double*, unsigned int,
+        unsigned int, const double*, unsigned int, double);
+#endif
+
 private:
     /// The interaction energy between particles and the wall.
     double wallInteractionEnergy;
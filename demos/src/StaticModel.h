@@ -0,0 +1,441 @@
+/*
+  Copyright (c) 2015-2016 Lester Hedges <lester.hedges+vmmc@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _STATICMODEL_H
+#define _STATICMODEL_H
+
+#include "Box.h"
+#include "Model.h"
+#include "Particle.h"
+
+/*! \file StaticModel.h
+*/
+
+//! Model base class with statically dispatched pair energies.
+/*! The derived class is passed as the template parameter (the curiously
+    recurring template pattern) and must define computePairEnergyFromDistance.
+    It may also define computeBatchEnergies, e.g. with a SIMD kernel. Both
+    are called by qualified name, so the per-pair calls in the neighbour
+    loops are resolved at compile time and can be inlined. This is the only
+    implementation of the energy methods of the (pure virtual) Model
+    interface, so models can still be used polymorphically via a Model
+    reference.
+
+    Derived classes declare StaticModel<Derived> a friend so that their
+    pair energy methods can remain protected.
+ */
+template <class Derived>
+class StaticModel : public Model
+{
+public:
+    //! Constructor.
+    /*! \param box_
+            A reference to the simulation box object.
+
+        \param particles_
+            A reference to the particle list.
+
+        \param cells_
+            A reference to the cell list object.
+
+        \param maxInteractions_
+            The maximum number of interactions per particle.
+
+        \param interactionEnergy_
+            The interaction energy (in units of kBT).
+
+        \param interactionRange_
+            The interaction range (in units of the particle diameter).
+     */
+    StaticModel(Box& box_, std::vector<Particle>& particles_, CellList& cells_,
+        unsigned int maxInteractions_, double interactionEnergy_, double interactionRange_) :
+        Model(box_, particles_, cells_, maxInteractions_, interactionEnergy_, interactionRange_) {}
+
+    //! Calculate the total interaction energy felt by a particle.
+    /*! \param index
+            The particle index.
+
+        \param position
+            The position vector of the particle.
+
+        \param type
+            The type of the particle.
+
+        \param orientation
+            The orientation vector of the particle.
+
+        \return
+            The total interaction energy.
+     */
+#ifndef ISOTROPIC
+    double computeEnergy(unsigned int, const double*, unsigned int, const double*);
+#else
+    double computeEnergy(unsigned int, const double*, unsigned int);
+#endif
+
+    //! Calculate the interaction energy felt by a particle due to particles outside the moving cluster.
+    /*! \param index
+            The particle index.
+
+        \param position
+            The position vector of the particle.
+
+        \param type
+            The type of the particle.
+
+        \param orientation
+            The orientation vector of the particle.
+
+        \param isMoving
+            Mask of particle indices, non-zero if the particle is part of the moving cluster.
+
+        \return
+            The interaction energy due to non-moving neighbours.
+     */
+#ifndef ISOTROPIC
+    double computeExternalEnergy(unsigned int, const double*, unsigned int, const double*, const char*);
+#else
+    double computeExternalEnergy(unsigned int, const double*, unsigned int, const char*);
+#endif
+
+    //! Calculate the pair energy between two particles.
+    /*! \param particle1
+            The index of the first particle.
+
+        \param position1
+            The position vector of the first particle.
+
+        \param type1
+            The type of the first particle.
+
+        \param orientation1
+            The orientation vector of the first particle.
+
+        \param particle2
+            The index of the second particle.
+
+        \param position2
+            The position vector of the second particle.
+
+        \param type2
+            The type of the second particle.
+
+        \param orientation2
+            The orientation vector of the second particle.
+
+        \return
+            The pair energy between particles 1 and 2.
+     */
+#ifndef ISOTROPIC
+    double computePairEnergy(unsigned int, const double*, unsigned int, const double*, unsigned int, const double*, unsigned int, const double*);
+#else
+    double computePairEnergy(unsigned int, const double*, unsigned int, unsigned int, const double*, unsigned int);
+#endif
+
+    //! Calculate the pair energy between two particles for several configurations of the first particle.
+    /*! \param particle1
+            The index of the first particle.
+
+        \param positions1
+            Pointers to the position vectors of the first particle.
+
+        \param type1
+            The type of the first particle.
+
+        \param orientations1
+            Pointers to the orientation vectors of the first particle.
+
+        \param nConfigurations
+            The number of configurations of the first particle.
+
+        \param particle2
+            The index of the second particle.
+
+        \param position2
+            The position vector of the second particle.
+
+        \param type2
+            The type of the second particle.
+
+        \param orientation2
+            The orientation vector of the second particle.
+
+        \param energies
+            An array to store the pair energy for each configuration.
+     */
+#ifndef ISOTROPIC
+    void computePairEnergy3(unsigned int, const double* const*, unsigned int, const double* const*, unsigned int,
+        unsigned int, const double*, unsigned int, const double*, double*);
+#else
+    void computePairEnergy3(unsigned int, const double* const*, unsigned int, unsigned int,
+        unsigned int, const double*, unsigned int, double*);
+#endif
+
+    //! Determine the interactions for a given particle along with the corresponding pair energies.
+    /*! \param particle
+            The particle index.
+
+        \param position
+            The position vector of the particle.
+
+        \param type
+            The type of the particle.
+
+        \param orientation
+            The orientation vector of the particle.
+
+        \param interactions
+            An array to store the indices of neighbours with which the particle interacts.
+
+        \param energies
+            An array to store the pair energy for each interaction.
+
+        \param squaredDistances
+            An array to store the squared separation for each interaction (may be null).
+
+        \return
+            The number of interactions.
+     */
+#ifndef ISOTROPIC
+    unsigned int computeInteractionEnergies(unsigned int, const double*, unsigned int, const double*, unsigned int*, double*, double*);
+#else
+    unsigned int computeInteractionEnergies(unsigned int, const double*, unsigned int, unsigned int*, double*, double*);
+#endif
+
+    //! Calculate the pair energies between a particle and a list of neighbours.
+    /*! \param particle
+            The index of the particle.
+
+        \param position
+            The position vector of the particle.
+
+        \param type
+            The type of the particle.
+
+        \param orientation
+            The orientation vector of the particle.
+
+        \param nNeighbours
+            The number of neighbours.
+
+        \param neighbours
+            The indices of the neighbours.
+
+        \param energies
+            An array to store the pair energy with each neighbour.
+     */
+#ifndef ISOTROPIC
+    void computePairEnergies(unsigned int, const double*, unsigned int, const double*, unsigned int, const unsigned int*, double*);
+#else
+    void computePairEnergies(unsigned int, const double*, unsigned int, unsigned int, const unsigned int*, double*);
+#endif
+
+protected:
+    //! Calculate the pair energy between a particle and a batch of neighbours.
+    /*! Each pair is evaluated with the derived class's computePairEnergyFromDistance.
+
+        \param particle
+            The index of the particle.
+
+        \param position
+            The position vector of the particle.
+
+        \param type
+            The type of the particle.
+
+        \param orientation
+            The orientation vector of the particle.
+
+        \param batch
+            The packed neighbours.
+     */
+#ifndef ISOTROPIC
+    void computeBatchEnergies(unsigned int, const double*, unsigned int, const double*, NeighbourBatch&);
+#else
+    void computeBatchEnergies(unsigned int, const double*, unsigned int, NeighbourBatch&);
+#endif
+
+private:
+    //! Get a reference to the derived model.
+    Derived& derived() { return *static_cast<Derived*>(this); }
+};
+
+#ifndef ISOTROPIC
+template <class Derived>
+double StaticModel<Derived>::computeEnergy(unsigned int particle, const double* position,
+    unsigned int type, const double* orientation)
+#else
+template <class Derived>
+double StaticModel<Derived>::computeEnergy(unsigned int particle, const double* position, unsigned int type)
+#endif
+{
+    gatherNeighbours(particle, type, nullptr);
+
+#ifndef ISOTROPIC
+    derived().Derived::computeBatchEnergies(particle, position, type, orientation, neighbourBatch);
+#else
+    derived().Derived::computeBatchEnergies(particle, position, type, neighbourBatch);
+#endif
+
+    return sumBatchEnergies();
+}
+
+#ifndef ISOTROPIC
+template <class Derived>
+double StaticModel<Derived>::computeExternalEnergy(unsigned int particle, const double* position,
+    unsigned int type, const double* orientation, const char* isMoving)
+#else
+template <class Derived>
+double StaticModel<Derived>::computeExternalEnergy(unsigned int particle, const double* position,
+    unsigned int type, const char* isMoving)
+#endif
+{
+    gatherNeighbours(particle, type, isMoving);
+
+#ifndef ISOTROPIC
+    derived().Derived::computeBatchEnergies(particle, position, type, orientation, neighbourBatch);
+#else
+    derived().Derived::computeBatchEnergies(particle, position, type, neighbourBatch);
+#endif
+
+    return sumBatchEnergies();
+}
+
+#ifndef ISOTROPIC
+template <class Derived>
+double StaticModel<Derived>::computePairEnergy(unsigned int particle1, const double* position1, unsigned int type1,
+    const double* orientation1, unsigned int particle2, const double* position2, unsigned int type2, const double* orientation2)
+#else
+template <class Derived>
+double StaticModel<Derived>::computePairEnergy(unsigned int particle1, const double* position1, unsigned int type1,
+    unsigned int particle2, const double* position2, unsigned int type2)
+#endif
+{
+    // Squared minimum image separation.
+    double normSqd = box.computeSquaredDistance(position1, position2);
+
+#ifndef ISOTROPIC
+    return derived().Derived::computePairEnergyFromDistance(particle1, position1, type1, orientation1,
+        particle2, position2, type2, orientation2, normSqd);
+#else
+    return derived().Derived::computePairEnergyFromDistance(particle1, position1, type1,
+        particle2, position2, type2, normSqd);
+#endif
+}
+
+#ifndef ISOTROPIC
+template <class Derived>
+void StaticModel<Derived>::computePairEnergy3(unsigned int particle1, const double* const* positions1, unsigned int type1,
+    const double* const* orientations1, unsigned int nConfigurations, unsigned int particle2,
+    const double* position2, unsigned int type2, const double* orientation2, double* energies)
+#else
+template <class Derived>
+void StaticModel<Derived>::computePairEnergy3(unsigned int particle1, const double* const* positions1, unsigned int type1,
+    unsigned int nConfigurations, unsigned int particle2, const double* position2, unsigned int type2, double* energies)
+#endif
+{
+    for (unsigned int i=0;i<nConfigurations;i++)
+    {
+        // Squared minimum image separation.
+        double normSqd = box.computeSquaredDistance(positions1[i], position2);
+
+#ifndef ISOTROPIC
+        energies[i] = derived().Derived::computePairEnergyFromDistance(particle1, positions1[i], type1, orientations1[i],
+            particle2, position2, type2, orientation2, normSqd);
+#else
+        energies[i] = derived().Derived::computePairEnergyFromDistance(particle1, positions1[i], type1,
+            particle2, position2, type2, normSqd);
+#endif
+    }
+}
+
+#ifndef ISOTROPIC
+template <class Derived>
+unsigned int StaticModel<Derived>::computeInteractionEnergies(unsigned int particle, const double* position,
+    unsigned int type, const double* orientation, unsigned int* interactions, double* energies, double* squaredDistances)
+#else
+template <class Derived>
+unsigned int StaticModel<Derived>::computeInteractionEnergies(unsigned int particle, const double* position,
+    unsigned int type, unsigned int* interactions, double* energies, double* squaredDistances)
+#endif
+{
+    gatherNeighbours(particle, type, nullptr);
+
+#ifndef ISOTROPIC
+    derived().Derived::computeBatchEnergies(particle, position, type, orientation, neighbourBatch);
+#else
+    derived().Derived::computeBatchEnergies(particle, position, type, neighbourBatch);
+#endif
+
+    return collectInteractions(type, interactions, energies, squaredDistances);
+}
+
+#ifndef ISOTROPIC
+template <class Derived>
+void StaticModel<Derived>::computePairEnergies(unsigned int particle, const double* position, unsigned int type,
+    const double* orientation, unsigned int nNeighbours, const unsigned int* neighbours, double* energies)
+#else
+template <class Derived>
+void StaticModel<Derived>::computePairEnergies(unsigned int particle, const double* position, unsigned int type,
+    unsigned int nNeighbours, const unsigned int* neighbours, double* energies)
+#endif
+{
+    neighbourBatch.size = 0;
+
+    for (unsigned int i=0;i<nNeighbours;i++)
+        appendNeighbour(neighbours[i]);
+
+#ifndef ISOTROPIC
+    derived().Derived::computeBatchEnergies(particle, position, type, orientation, neighbourBatch);
+#else
+    derived().Derived::computeBatchEnergies(particle, position, type, neighbourBatch);
+#endif
+
+    for (unsigned int i=0;i<nNeighbours;i++)
+        energies[i] = neighbourBatch.energies[i];
+}
+
+#ifndef ISOTROPIC
+template <class Derived>
+void StaticModel<Derived>::computeBatchEnergies(unsigned int particle, const double* position, unsigned int type,
+    const double* orientation, NeighbourBatch& batch)
+#else
+template <class Derived>
+void StaticModel<Derived>::computeBatchEnergies(unsigned int particle, const double* position, unsigned int type,
+    NeighbourBatch& batch)
+#endif
+{
+    for (unsigned int i=0;i<batch.size;i++)
+    {
+        unsigned int neighbour = batch.indices[i];
+
+        // Squared minimum image separation.
+        double normSqd = box.computeSquaredDistance(position, &particles[neighbour].position[0]);
+
+        batch.squaredDistances[i] = normSqd;
+
+#ifndef ISOTROPIC
+        batch.energies[i] = derived().Derived::computePairEnergyFromDistance(particle, position, type, orientation,
+            neighbour, &particles[neighbour].position[0], batch.types[i], &particles[neighbour].orientation[0], normSqd);
+#else
+        batch.energies[i] = derived().Derived::computePairEnergyFromDistance(particle, position, type,
+            neighbour, &particles[neighbour].position[0], batch.types[i], normSqd);
+#endif
+    }
+}
+
+#endif  /* _STATICMODEL_H */
@@ -0,0 +1,267 @@
+/*
+  Copyright (c) 2015-2016 Lester Hedges <lester.hedges+vmmc@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "Box.h"
+#include "CellList.h"
+#include "Particle.h"
+#include "TabulatedModel.h"
+
+TabulatedModel::TabulatedModel(
+    Box& box_,
+    std::vector<Particle>& particles_,
+    CellList& cells_,
+    unsigned int maxInteractions_,
+    double interactionEnergy_,
+    double interactionRange_) :
+    StaticModel<TabulatedModel>(box_, particles_, cells_, maxInteractions_, interactionEnergy_, interactionRange_),
+    interpolation(CUBIC),
+    tableTypes(0),
+    stride(4),
+    squaredInnerDistance(0),
+    isTabulated(false)
+{
+}
+
+void TabulatedModel::tabulate(const RadialPotential& potential_, unsigned int nTypes_,
+    Interpolation interpolation_, double tolerance, double innerDistance)
+{
+    // Check that the table parameters are valid.
+    if (nTypes_ == 0)
+    {
+        std::cerr << "[ERROR] TabulatedModel: Number of particle types must be > 0!\n";
+        exit(EXIT_FAILURE);
+    }
+    if (tolerance <= 0)
+    {
+        std::cerr << "[ERROR] TabulatedModel: Interpolation tolerance must be > 0!\n";
+        exit(EXIT_FAILURE);
+    }
+    if (innerDistance <= 0)
+    {
+        std::cerr << "[ERROR] TabulatedModel: Inner distance must be > 0!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    // Type-dependent cut-offs must cover the same types as the table.
+    if ((nTypes > 0) && (nTypes != nTypes_))
+    {
+        std::cerr << "[ERROR] TabulatedModel: Number of tabulated types doesn't match the interaction range table!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    // Every particle must have an entry in the table.
+    for (unsigned int i=0;i<particles.size();i++)
+    {
+        if (particles[i].type >= nTypes_)
+        {
+            std::cerr << "[ERROR] TabulatedModel: Particle type exceeds the number of tabulated types!\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    potential = potential_;
+    interpolation = interpolation_;
+    tableTypes = nTypes_;
+    stride = (interpolation == LINEAR) ? 2 : 4;
+    squaredInnerDistance = innerDistance*innerDistance;
+
+    entries.resize(tableTypes*tableTypes);
+    coefficients.clear();
+
+    std::vector<double> pairCoefficients;
+
+    for (unsigned int i=0;i<tableTypes;i++)
+    {
+        for (unsigned int j=0;j<tableTypes;j++)
+        {
+            unsigned int pair = i*tableTypes + j;
+            TableEntry& entry = entries[pair];
+
+            // The potential is symmetric, so share the table.
+            if (j < i)
+            {
+                entry = entries[j*tableTypes + i];
+                continue;
+            }
+
+            // Use the cut-off for this pair of types, if set.
+            if (nTypes > 0) entry.squaredCutOff = squaredTypeCutOffs[pair];
+            else entry.squaredCutOff = squaredCutOffDistance;
+
+            entry.inverseSpacing = 0;
+            entry.offset = coefficients.size() / stride;
+            entry.nIntervals = 0;
+
+            // Nothing to tabulate.
+            if (entry.squaredCutOff <= squaredInnerDistance) continue;
+
+            // Refine the grid until the interpolation error is within the bound.
+            for (entry.nIntervals=MIN_INTERVALS;;entry.nIntervals*=2)
+            {
+                if (entry.nIntervals > MAX_INTERVALS)
+                {
+                    std::cerr << "[ERROR] TabulatedModel: Unable to tabulate potential within the error bound!\n";
+                    exit(EXIT_FAILURE);
+                }
+
+                entry.inverseSpacing = entry.nIntervals / (entry.squaredCutOff - squaredInnerDistance);
+
+                fillTable(pair, i, j, pairCoefficients);
+                if (computeError(pair, i, j, pairCoefficients) <= tolerance) break;
+            }
+
+            coefficients.insert(coefficients.end(), pairCoefficients.begin(), pairCoefficients.end());
+        }
+    }
+
+    isTabulated = true;
+}
+
+unsigned int TabulatedModel::getTableSize() const
+{
+    return coefficients.size() / stride;
+}
+
+#ifndef ISOTROPIC
+double TabulatedModel::computePairEnergyFromDistance(unsigned int particle1, const double* position1, unsigned int type1,
+    const double* orientation1, unsigned int particle2, const double* position2, unsigned int type2,
+    const double* orientation2, double normSqd)
+#else
+double TabulatedModel::computePairEnergyFromDistance(unsigned int particle1, const double* position1, unsigned int type1,
+    unsigned int particle2, const double* position2, unsigned int type2, double normSqd)
+#endif
+{
+    return lookup(normSqd, type1, type2);
+}
+
+double TabulatedModel::lookup(double normSqd, unsigned int type1, unsigned int type2) const
+{
+    // The table is empty until the potential is tabulated.
+    if (!isTabulated)
+    {
+        std::cerr << "[ERROR] TabulatedModel: Potential must be tabulated before computing energies!\n";
+        exit(EXIT_FAILURE);
+    }
+
+    assert((type1 < tableTypes) && (type2 < tableTypes));
+
+    const TableEntry& entry = entries[type1*tableTypes + type2];
+
+    // Beyond the cut-off.
+    if (normSqd >= entry.squaredCutOff) return 0;
+
+    // Deep within the core, use the analytic form.
+    if (normSqd < squaredInnerDistance) return potential(normSqd, type1, type2);
+
+    // Locate the grid interval (guarding against rounding at the cut-off).
+    double u = (normSqd - squaredInnerDistance)*entry.inverseSpacing;
+    unsigned int interval = (unsigned int) u;
+    if (interval >= entry.nIntervals) interval = entry.nIntervals - 1;
+
+    double t = u - interval;
+    const double* c = &coefficients[stride*(entry.offset + interval)];
+
+    if (interpolation == LINEAR) return c[0] + t*c[1];
+    else return c[0] + t*(c[1] + t*(c[2] + t*c[3]));
+}
+
+void TabulatedModel::fillTable(unsigned int pair, unsigned int type1, unsigned int type2, std::vector<double>& coefficients_)
+{
+    const TableEntry& entry = entries[pair];
+    unsigned int nIntervals = entry.nIntervals;
+    double spacing = 1.0 / entry.inverseSpacing;
+
+    // Potential at each grid point.
+    std::vector<double> values(nIntervals + 1);
+
+    for (unsigned int i=0;i<nIntervals;i++)
+        values[i] = potential(squaredInnerDistance + i*spacing, type1, type2);
+
+    // The last grid point lies just within the cut-off.
+    values[nIntervals] = potential(std::nextafter(entry.squaredCutOff, 0.0), type1, type2);
+
+    coefficients_.resize(stride*nIntervals);
+
+    if (interpolation == LINEAR)
+    {
+        for (unsigned int i=0;i<nIntervals;i++)
+        {
+            coefficients_[2*i]     = values[i];
+            coefficients_[2*i + 1] = values[i+1] - values[i];
+        }
+    }
+    else
+    {
+        // Cubic Hermite spline with finite difference slopes (per interval).
+        std::vector<double> slopes(nIntervals + 1);
+
+        slopes[0] = values[1] - values[0];
+        slopes[nIntervals] = values[nIntervals] - values[nIntervals-1];
+        for (unsigned int i=1;i<nIntervals;i++)
+            slopes[i] = 0.5*(values[i+1] - values[i-1]);
+
+        for (unsigned int i=0;i<nIntervals;i++)
+        {
+            double delta = values[i+1] - values[i];
+
+            coefficients_[4*i]     = values[i];
+            coefficients_[4*i + 1] = slopes[i];
+            coefficients_[4*i + 2] = 3*delta - 2*slopes[i] - slopes[i+1];
+            coefficients_[4*i + 3] = -2*delta + slopes[i] + slopes[i+1];
+        }
+    }
+}
+
+double TabulatedModel::computeError(unsigned int pair, unsigned int type1, unsigned int type2,
+    const std::vector<double>& coefficients_) const
+{
+    const TableEntry& entry = entries[pair];
+    double spacing = 1.0 / entry.inverseSpacing;
+    double maxError = 0;
+
+    // Compare with the analytic form within each interval.
+    for (unsigned int i=0;i<entry.nIntervals;i++)
+    {
+        const double* c = &coefficients_[stride*i];
+
+        for (unsigned int j=1;j<4;j++)
+        {
+            double t = 0.25*j;
+            double exact = potential(squaredInnerDistance + (i + t)*spacing, type1, type2);
+
+            double value;
+            if (interpolation == LINEAR) value = c[0] + t*c[1];
+            else value = c[0] + t*(c[1] + t*(c[2] + t*c[3]));
+
+            double error = std::abs(value - exact) / std::max(1.0, std::abs(exact));
+
+            // Catch undefined values, e.g. from an infinite potential.
+            if (std::isnan(error)) return INF;
+
+            maxError = std::max(maxError, error);
+        }
+    }
+
+    return maxError;
+}
@@ -0,0 +1,225 @@
+/*
+  Copyright (c) 2015-2016 Lester Hedges <lester.hedges+vmmc@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TABULATEDMODEL_H
+#define _TABULATEDMODEL_H
+
+#include <functional>
+
+#include "StaticModel.h"
+
+/*! \file TabulatedModel.h
+*/
+
+//! Class defining a radial pair potential that is evaluated from a lookup table.
+/*! An analytic potential, e.g. CosSquared::computeRadialEnergy, is tabulated
+    for each pair of particle types on a uniform grid in the squared separation,
+    so that pair energies cost a table lookup rather than a square root or
+    transcendental function. Separations below the inner distance of the table,
+    i.e. within the core, fall back on the analytic form.
+ */
+class TabulatedModel : public StaticModel<TabulatedModel>
+{
+    friend class StaticModel<TabulatedModel>;
+
+public:
+    //! Analytic radial potential prototype.
+    /*! \param normSqd
+            The squared separation between the particles.
+
+        \param type1
+            The type of the first particle.
+
+        \param type2
+            The type of the second particle.
+
+        \return
+            The pair energy.
+     */
+    typedef std::function<double (double, unsigned int, unsigned int)> RadialPotential;
+
+    //! Interpolation schemes.
+    enum Interpolation {LINEAR, CUBIC};
+
+    //! Constructor.
+    /*! \param box_
+            A reference to the simulation box object.
+
+        \param particles_
+            A reference to the particle list.
+
+        \param cells_
+            A reference to the cell list object.
+
+        \param maxInteractions_
+            The maximum number of interactions per particle.
+
+        \param interactionEnergy_
+            The potential energy scale (in units of kBT).
+
+        \param interactionRange_
+            The potential cut-off distance.
+     */
+    TabulatedModel(Box&, std::vector<Particle>&, CellList&, unsigned int, double, double);
+
+    //! Tabulate a radial potential.
+    /*! The table for each pair of types extends from the inner distance to
+        the cut-off for that pair (see Model::setInteractionRanges, which should
+        be called first if type-dependent cut-offs are used). The number of grid
+        points is doubled until the interpolation error is within the bound,
+        so the potential must be continuous within the table. The number of
+        types must match that of the interaction range table (if set), and
+        every particle type must lie within the table. This must be called
+        before any energies are computed.
+
+        \param potential
+            The analytic potential.
+
+        \param nTypes_
+            The number of particle types, i.e. types run from 0 to nTypes_-1.
+
+        \param interpolation_
+            The interpolation scheme.
+
+        \param tolerance
+            The maximum interpolation error, relative to the larger of one
+            and the magnitude of the pair energy (in units of kBT).
+
+        \param innerDistance
+            The smallest separation that is tabulated (in units of particle diameter).
+     */
+    void tabulate(const RadialPotential&, unsigned int nTypes_ = 2,
+        Interpolation interpolation_ = CUBIC, double tolerance = 1e-6, double innerDistance = 1.0);
+
+    //! Get the total number of grid intervals in the table.
+    /*! \return
+            The number of intervals, summed over all pairs of types.
+     */
+    unsigned int getTableSize() const;
+
+protected:
+    //! Calculate the pair energy between two particles with a known separation.
+    /*! \param particle1
+            The index of the first particle.
+
+        \param position1
+            The position vector of the first particle.
+
+        \param type1
+            The type of the first particle.
+
+        \param orientation1
+            The orientation vector of the first particle.
+
+        \param particle2
+            The index of the second particle.
+
+        \param position2
+            The position vector of the second particle.
+
+        \param type2
+            The type of the second particle.
+
+        \param orientation2
+            The orientation vector of the second particle.
+
+        \param normSqd
+            The squared minimum image separation between the particles.
+
+        \return
+            The pair energy between particles 1 and 2.
+     */
+#ifndef ISOTROPIC
+    double computePairEnergyFromDistance(unsigned int, const double*, unsigned int, const double*,
+        unsigned int, const double*, unsigned int, const double*, double);
+#else
+    double computePairEnergyFromDistance(unsigned int, const double*, unsigned int,
+        unsigned int, const double*, unsigned int, double);
+#endif
+
+private:
+    //! Grid parameters of the table for a pair of types.
+    struct TableEntry
+    {
+        double squaredCutOff;               //!< The squared cut-off distance.
+        double inverseSpacing;              //!< The inverse grid spacing (in squared separation).
+        unsigned int offset;                //!< Offset of the first interval in the coefficient table.
+        unsigned int nIntervals;            //!< The number of grid intervals.
+    };
+
+    //! Look up the pair energy for a given squared separation.
+    /*! \param normSqd
+            The squared separation between the particles.
+
+        \param type1
+            The type of the first particle.
+
+        \param type2
+            The type of the second particle.
+
+        \return
+            The pair energy.
+     */
+    double lookup(double, unsigned int, unsigned int) const;
+
+    //! Fill the polynomial coefficients for a pair of types.
+    /*! \param pair
+            The index of the pair of types.
+
+        \param type1
+            The type of the first particle.
+
+        \param type2
+            The type of the second particle.
+
+        \param coefficients
+            The coefficient table to fill.
+     */
+    void fillTable(unsigned int, unsigned int, unsigned int, std::vector<double>&);
+
+    //! Compute the maximum relative interpolation error for a pair of types.
+    /*! \param pair
+            The index of the pair of types.
+
+        \param type1
+            The type of the first particle.
+
+        \param type2
+            The type of the second particle.
+
+        \param coefficients
+            The coefficient table.
+
+        \return
+            The maximum relative error.
+     */
+    double computeError(unsigned int, unsigned int, unsigned int, const std::vector<double>&) const;
+
+    RadialPotential potential;              //!< The analytic potential.
+    Interpolation interpolation;            //!< The interpolation scheme.
+    unsigned int tableTypes;                //!< The number of particle types in the table.
+    unsigned int stride;                    //!< The number of coefficients per interval.
+    double squaredInnerDistance;            //!< The smallest tabulated squared separation.
+    std::vector<TableEntry> entries;        //!< The table grid for each pair of types.
+    std::vector<double> coefficients;       //!< Polynomial coefficients for each interval (contiguous for each pair).
+    bool isTabulated;                       //!< Whether the potential has been tabulated.
+
+    static const unsigned int MIN_INTERVALS = 64;           //!< The initial number of grid intervals.
+    static const unsigned int MAX_INTERVALS = 1 << 20;      //!< The maximum number of grid intervals per pair.
+};
+
+#endif  /* _TABULATEDMODEL_H */
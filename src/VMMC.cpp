@@ -15,6 +15,8 @@
   along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>
 #include <iostream>
 
@@ -28,8 +30,6 @@ namespace vmmc
     {
         // Resize position/orientation vectors.
         preMovePosition.resize(dimension);
-        preMoveType;
-        postMoveType;
         postMovePosition.resize(dimension);
         clusterPosition.resize(dimension);
 #ifndef ISOTROPIC
@@ -61,6 +61,11 @@ namespace vmmc
         nAttempts(0),
         nAccepts(0),
         nRotations(0),
+        nVolumeAttempts(0),
+        nVolumeAccepts(0),
+        energyCheckInterval(0),
+        energyTolerance(0),
+        energyDrift(0),
         nParticles(nParticles_),
         dimension(dimension_),
         maxTrialTranslation(maxTrialTranslation_),
@@ -112,8 +117,9 @@ namespace vmmc
         // N.B. There's no need to check probTranslate since anything less than zero
         // will be treated as zero, and anything greater than one will be treated as one.
 
-        // Store simulation box size.
+        // Store simulation box size (periodic by default).
         boxSize.resize(dimension);
+        isPeriodic.assign(dimension, true);
         for (unsigned int i=0;i<dimension;i++)
         {
             boxSize[i] = boxSize_[i];
@@ -128,11 +134,16 @@ namespace vmmc
 
         // Allocate memory.
         moveParams.trialVector.resize(dimension);
+        firstMoment.resize(dimension);
+        moveParams.rotationMatrix.resize(dimension*dimension);
+        moveParams.reverseRotationMatrix.resize(dimension*dimension);
         particles.resize(nParticles);
         moveList.resize(nParticles);
+        movingMask.resize(nParticles);
         clusterTranslations.resize(nParticles);
         clusterRotations.resize(nParticles);
         frustratedLinks.resize(nParticles);
+        externalIndices.resize(nParticles);
 #ifndef ISOTROPIC
         isIsotropic.resize(nParticles);
 #endif
@@ -149,12 +160,18 @@ namespace vmmc
             particles[i].postMoveOrientation.resize(dimension);
 #endif
             
+            // Particles start in their external order.
+            particles[i].index = i;
+            externalIndices[i] = i;
+
             // Initialise moving boolean flag.
             particles[i].isMoving = false;
 
             // Initialise frustrated boolean flag.
             particles[i].isFrustrated = false;
             particles[i].preMoveType = types[i];
+            particles[i].postMoveType = types[i];
+
             // Copy particle coordinates and orientations.
             for (unsigned int j=0;j<dimension;j++)
             {
@@ -211,6 +228,33 @@ namespace vmmc
         if (callbacks.boundaryCallback == nullptr) callbacks.isCustomBoundary = false;
         else callbacks.isCustomBoundary = true;
 
+        // Check for external energy callback function.
+        if (callbacks.externalEnergyCallback == nullptr) callbacks.isExternalEnergy = false;
+        else callbacks.isExternalEnergy = true;
+
+        // Check for multi-configuration pair energy callback function.
+        if (callbacks.pairEnergy3Callback == nullptr) callbacks.isPairEnergy3 = false;
+        else callbacks.isPairEnergy3 = true;
+
+        // Check for interaction energies callback function.
+        if (callbacks.interactionEnergiesCallback == nullptr) callbacks.isInteractionEnergies = false;
+        else callbacks.isInteractionEnergies = true;
+
+        // Check for batch pair energies callback function.
+        if (callbacks.pairEnergiesCallback == nullptr) callbacks.isPairEnergies = false;
+        else callbacks.isPairEnergies = true;
+
+        // Check for reorder callback function.
+        if (callbacks.reorderCallback == nullptr) callbacks.isReorder = false;
+        else callbacks.isReorder = true;
+
+        // Check for volume change callback function.
+        if (callbacks.volumeChangeCallback == nullptr) callbacks.isVolumeChange = false;
+        else callbacks.isVolumeChange = true;
+
+        // Initialise the running total energy.
+        computeEnergy();
+
 /*        std::cout << "Initialised VMMC";
 #ifdef ISOTROPIC
         std::cout << " (isotropic)";
@@ -227,6 +271,40 @@ namespace vmmc
             
     }
 
+    VMMC::VMMC(
+        unsigned int nParticles_,
+        unsigned int dimension_,
+        double* coordinates,
+        int* types,
+#ifndef ISOTROPIC
+        double* orientations,
+#endif
+        double maxTrialTranslation_,
+        double maxTrialRotation_,
+        double probTranslate_,
+        double referenceRadius_,
+        unsigned int maxInteractions_,
+        double* boxSize_,
+        bool* isPeriodic_,
+#ifndef ISOTROPIC
+        bool* isIsotropic_,
+#endif
+        bool isRepusive_,
+        const CallbackFunctions& callbacks_) :
+
+#ifndef ISOTROPIC
+        VMMC(nParticles_, dimension_, coordinates, types, orientations, maxTrialTranslation_, maxTrialRotation_,
+            probTranslate_, referenceRadius_, maxInteractions_, boxSize_, isIsotropic_, isRepusive_, callbacks_)
+#else
+        VMMC(nParticles_, dimension_, coordinates, types, maxTrialTranslation_, maxTrialRotation_,
+            probTranslate_, referenceRadius_, maxInteractions_, boxSize_, isRepusive_, callbacks_)
+#endif
+    {
+        // Store periodicity of the simulation box.
+        for (unsigned int i=0;i<dimension;i++)
+            isPeriodic[i] = isPeriodic_[i];
+    }
+
     void VMMC::step(const int nSteps)
     {
         for (int i=0;i<nSteps;i++)
@@ -260,6 +338,14 @@ namespace vmmc
         // Reset early exit flag.
         isEarlyExit = false;
 
+        // Reset the tested links.
+        linkNeighbours.clear();
+        linkEnergies.clear();
+
+        // Reset cluster moments.
+        std::fill(firstMoment.begin(), firstMoment.end(), 0);
+        secondMoment = 0;
+
         // Propose a move for the cluster.
         proposeMove();
 
@@ -287,7 +373,11 @@ namespace vmmc
         }
 
         // Reset the move list.
-        for (unsigned int i=0;i<nMoving;i++) particles[moveList[i]].isMoving = false;
+        for (unsigned int i=0;i<nMoving;i++)
+        {
+            particles[moveList[i]].isMoving = false;
+            movingMask[moveList[i]] = 0;
+        }
 
         // Reset frustrated links.
         for (unsigned int i=0;i<nFrustrated;i++) particles[frustratedLinks[i]].isFrustrated = false;
@@ -298,6 +388,9 @@ namespace vmmc
             for (unsigned int i=0;i<nInteractions;i++)
                 pairEnergyMatrix[interactions[i][0]][interactions[i][1]] = 0;
         }
+
+        // Check for drift in the running total energy.
+        if (energyCheckInterval > 0 && (nAttempts % energyCheckInterval) == 0) checkEnergy();
     }
 
     unsigned long long VMMC::getAttempts() const
@@ -315,6 +408,88 @@ namespace vmmc
         return nRotations;
     }
 
+    unsigned long long VMMC::getVolumeAttempts() const
+    {
+        return nVolumeAttempts;
+    }
+
+    unsigned long long VMMC::getVolumeAccepts() const
+    {
+        return nVolumeAccepts;
+    }
+
+    const std::vector<double>& VMMC::getBoxSize() const
+    {
+        return boxSize;
+    }
+
+    double VMMC::getEnergy() const
+    {
+        return totalEnergy;
+    }
+
+    double VMMC::computeEnergy()
+    {
+        double pairEnergy = 0;
+        double nonPairwiseEnergy = 0;
+
+        for (unsigned int i=0;i<nParticles;i++)
+        {
+            // Each pair is counted from both sides.
+#ifndef ISOTROPIC
+            pairEnergy += callbacks.energyCallback(i, &particles[i].preMovePosition[0],
+                particles[i].preMoveType, &particles[i].preMoveOrientation[0]);
+#else
+            pairEnergy += callbacks.energyCallback(i, &particles[i].preMovePosition[0], particles[i].preMoveType);
+#endif
+
+            if (callbacks.isNonPairwise)
+            {
+#ifndef ISOTROPIC
+                nonPairwiseEnergy += callbacks.nonPairwiseCallback(i, &particles[i].preMovePosition[0],
+                    &particles[i].preMoveOrientation[0]);
+#else
+                nonPairwiseEnergy += callbacks.nonPairwiseCallback(i, &particles[i].preMovePosition[0]);
+#endif
+            }
+        }
+
+        totalEnergy = 0.5*pairEnergy + nonPairwiseEnergy;
+
+        return totalEnergy;
+    }
+
+    void VMMC::setEnergyCheck(unsigned long long interval, double tolerance)
+    {
+        if (tolerance < 0)
+        {
+            std::cerr << "[ERROR] VMMC: Energy tolerance must be >= 0!\n";
+            exit(EXIT_FAILURE);
+        }
+
+        energyCheckInterval = interval;
+        energyTolerance = tolerance;
+    }
+
+    double VMMC::getEnergyDrift() const
+    {
+        return energyDrift;
+    }
+
+    void VMMC::checkEnergy()
+    {
+        double runningEnergy = totalEnergy;
+        double drift = std::abs(computeEnergy() - runningEnergy);
+
+        energyDrift = std::max(energyDrift, drift);
+
+        if (drift > energyTolerance*std::max(1.0, std::abs(totalEnergy)))
+        {
+            std::cerr << "[ERROR] VMMC: Energy drift of " << drift << " exceeds tolerance!\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+
     void VMMC::getClusterTranslations(unsigned long long clusterStatistics[]) const
     {
         for (unsigned int i=0;i<nParticles;i++)
@@ -340,10 +515,183 @@ namespace vmmc
     void VMMC::reset()
     {
         nAttempts = nAccepts = nRotations = 0;
+        nVolumeAttempts = nVolumeAccepts = 0;
         std::fill(clusterTranslations.begin(), clusterTranslations.end(), 0);
         std::fill(clusterRotations.begin(), clusterRotations.end(), 0);
     }
 
+    void VMMC::reorder()
+    {
+        // The model must apply the same permutation to its own storage.
+        if (!callbacks.isReorder)
+        {
+            std::cerr << "[ERROR] VMMC: Reordering requires a reorder callback!\n";
+            exit(EXIT_FAILURE);
+        }
+
+        // Morton code and current index of each particle.
+        std::vector<std::pair<unsigned long long, unsigned int> > codes(nParticles);
+
+        for (unsigned int i=0;i<nParticles;i++)
+            codes[i] = std::make_pair(computeMortonCode(particles[i].preMovePosition), i);
+
+        // Sort along the space-filling curve (ties are broken by index).
+        std::sort(codes.begin(), codes.end());
+
+        std::vector<unsigned int> order(nParticles);
+        for (unsigned int i=0;i<nParticles;i++) order[i] = codes[i].second;
+
+        // Permute particle storage.
+        std::vector<Particle> newParticles(nParticles);
+        std::vector<unsigned int> newExternalIndices(nParticles);
+#ifndef ISOTROPIC
+        std::vector<bool> newIsIsotropic(nParticles);
+#endif
+
+        for (unsigned int i=0;i<nParticles;i++)
+        {
+            std::swap(newParticles[i], particles[order[i]]);
+            newParticles[i].index = i;
+            newExternalIndices[i] = externalIndices[order[i]];
+#ifndef ISOTROPIC
+            newIsIsotropic[i] = isIsotropic[order[i]];
+#endif
+        }
+
+        particles.swap(newParticles);
+        externalIndices.swap(newExternalIndices);
+#ifndef ISOTROPIC
+        isIsotropic.swap(newIsIsotropic);
+#endif
+
+        // Apply the same permutation to the model.
+        callbacks.reorderCallback(&order[0]);
+    }
+
+    unsigned int VMMC::getExternalIndex(unsigned int particle) const
+    {
+        return externalIndices[particle];
+    }
+
+    const std::vector<unsigned int>& VMMC::getExternalIndices() const
+    {
+        return externalIndices;
+    }
+
+    bool VMMC::volumeMove(double pressure, double maxVolumeChange)
+    {
+        // Volume moves rescale the entire box.
+        if (callbacks.isCustomBoundary || std::find(isPeriodic.begin(), isPeriodic.end(), false) != isPeriodic.end())
+        {
+            std::cerr << "[ERROR] VMMC: Volume moves require a fully periodic simulation box!\n";
+            exit(EXIT_FAILURE);
+        }
+
+        // The model must be kept in sync with the box.
+        if (!callbacks.isVolumeChange)
+        {
+            std::cerr << "[ERROR] VMMC: Volume moves require a volume change callback!\n";
+            exit(EXIT_FAILURE);
+        }
+
+        // Increment number of attempted volume moves.
+        nVolumeAttempts++;
+
+        // Divide the particles into rigid clusters.
+        std::vector<unsigned int> clusterIndex, members, clusterStart;
+        std::vector<double> unwrapped, centres;
+        if (!computeClusters(clusterIndex, members, clusterStart, unwrapped, centres)) return false;
+
+        unsigned int nClusters = clusterStart.size() - 1;
+
+        // Propose a new volume.
+        double volume = 1;
+        for (unsigned int i=0;i<dimension;i++) volume *= boxSize[i];
+
+        double newVolume = volume + maxVolumeChange*(2*rng() - 1);
+        if (newVolume <= 0) return false;
+
+        double scale = std::pow(newVolume/volume, 1.0/dimension);
+
+        // Clusters are translated rigidly, so only non-pairwise energies can change
+        // unless a new interaction forms between clusters (which is tested below).
+        double energy = 0;
+        if (callbacks.isNonPairwise) energy = computeNonPairwiseEnergy(members);
+
+        // Store the current configuration.
+        std::vector<double> oldBoxSize(boxSize);
+        std::vector<double> oldCoordinates(dimension*nParticles);
+        std::vector<double> coordinates(dimension*nParticles);
+
+        for (unsigned int i=0;i<nParticles;i++)
+            for (unsigned int j=0;j<dimension;j++)
+                oldCoordinates[dimension*i + j] = particles[i].preMovePosition[j];
+
+        // Rescale the box.
+        for (unsigned int i=0;i<dimension;i++) boxSize[i] *= scale;
+
+        // Translate each cluster with its centre of mass. Members are displaced from
+        // their unwrapped positions, since the old and new periodic images differ.
+        for (unsigned int i=0;i<nClusters;i++)
+        {
+            for (unsigned int j=clusterStart[i];j<clusterStart[i+1];j++)
+            {
+                unsigned int particle = members[j];
+
+                for (unsigned int k=0;k<dimension;k++)
+                {
+                    double x = unwrapped[dimension*particle + k] + (scale - 1)*centres[dimension*i + k];
+                    particles[particle].preMovePosition[k] = x - boxSize[k]*std::floor(x/boxSize[k]);
+                }
+            }
+        }
+
+        for (unsigned int i=0;i<nParticles;i++)
+        {
+            applyPeriodicBoundaryConditions(particles[i].preMovePosition);
+
+            for (unsigned int j=0;j<dimension;j++)
+                coordinates[dimension*i + j] = particles[i].preMovePosition[j];
+        }
+
+        // Update the model.
+        callbacks.volumeChangeCallback(&boxSize[0], &coordinates[0]);
+
+        // Clusters contain every interacting pair and are rigid, so pair energies can
+        // only change if particles in different clusters (or different images of a
+        // cluster) now interact. Such a move has no reverse, so reject it. Otherwise
+        // the pair energy is unchanged.
+        bool isAccepted = false;
+        double energyChange = 0;
+        if (!isInterClusterInteraction(clusterIndex, unwrapped))
+        {
+            if (callbacks.isNonPairwise) energyChange = computeNonPairwiseEnergy(members) - energy;
+
+            double factor = std::exp(-energyChange - pressure*(newVolume - volume)
+                + nClusters*std::log(newVolume/volume));
+
+            isAccepted = (rng() < factor);
+        }
+
+        if (isAccepted)
+        {
+            nVolumeAccepts++;
+            totalEnergy += energyChange;
+            return true;
+        }
+
+        // Restore the original configuration.
+        boxSize = oldBoxSize;
+
+        for (unsigned int i=0;i<nParticles;i++)
+            for (unsigned int j=0;j<dimension;j++)
+                particles[i].preMovePosition[j] = oldCoordinates[dimension*i + j];
+
+        callbacks.volumeChangeCallback(&boxSize[0], &oldCoordinates[0]);
+
+        return false;
+    }
+
     void VMMC::proposeMove()
     {
         // Choose a seed particle.
@@ -361,6 +709,10 @@ namespace vmmc
         // Cluster size cut-off.
         cutOff = int(1.0/r);
 
+        // Draw the Stokes drag test up front so that recruitment can be
+        // aborted as soon as the cluster is guaranteed to be rejected.
+        stokesUniform = rng();
+
         // Choose a random point on the surface of the unit sphere/circle.
         for (unsigned int i=0;i<dimension;i++)
             moveParams.trialVector[i] = rng.normal();
@@ -389,6 +741,11 @@ namespace vmmc
             moveParams.isRotation = true;
             moveParams.stepSize = maxTrialRotation*(2.0*rng()-1.0);
 
+            // The angle and axis are fixed for the whole move, so compute the
+            // forward and reverse rotation matrices once.
+            computeRotationMatrix(moveParams.stepSize, moveParams.rotationMatrix);
+            computeRotationMatrix(-moveParams.stepSize, moveParams.reverseRotationMatrix);
+
             // Check whether seed particle is isotropic.
 #ifndef ISOTROPIC
             if (isIsotropic[moveParams.seed])
@@ -460,10 +817,10 @@ namespace vmmc
         }
 
         // Calculate the approximate Stokes scaling factor.
-        double scaleFactor = (nMoving > 1) ? computeHydrodynamicRadius() : 1.0;
+        double scaleFactor = (nMoving > 1) ? computeHydrodynamicRadius(nMoving) : 1.0;
 
         // Stokes drag rejection.
-        if (rng() > scaleFactor)
+        if (stokesUniform > scaleFactor)
         {
             isEarlyExit = true;
             return false;
@@ -473,39 +830,29 @@ namespace vmmc
         double energy;
         double excessEnergy = 0;
 
+        // Energy between the cluster and its environment (plus any non-pairwise
+        // energy) before and after the move, for the running total.
+        double initialEnergy = 0;
+        double finalEnergy = 0;
+
         // Construct pair interaction matrix (finite repulsions only).
         if (isRepusive)
         {
             unsigned int x, y;
             unsigned int nPairs;
             unsigned int pairInteractions[maxInteractions];
+            double pairEnergies[maxInteractions];
 
             // Check all particles in the moving cluster.
             for (unsigned int i=0;i<nMoving;i++)
             {
-                // Get a list of pair interactions.
-#ifndef ISOTROPIC
-                nPairs = callbacks.interactionsCallback(moveList[i], &particles[moveList[i]].preMovePosition[0],
-                    &particles[moveList[i]].preMoveOrientation[0], pairInteractions);
-#else
-                nPairs = callbacks.interactionsCallback(moveList[i],
-                    &particles[moveList[i]].preMovePosition[0], pairInteractions);
-#endif
+                // Get a list of pair interactions (and energies).
+                nPairs = computeInteractions(moveList[i], pairInteractions, pairEnergies);
 
                 // Test all pair interactions.
                 for (unsigned int j=0;j<nPairs;j++)
                 {
-#ifndef ISOTROPIC
-                    energy = callbacks.pairEnergyCallback(moveList[i],
-                        &particles[moveList[i]].preMovePosition[0],particles[moveList[i]].preMoveType, 
-                        &particles[moveList[i]].preMoveOrientation[0],pairInteractions[j], 
-                        &particles[pairInteractions[j]].preMovePosition[0],particles[pairInteractions[j]].preMoveType,
-                        &particles[pairInteractions[j]].preMoveOrientation[0]);
-#else
-                    energy = callbacks.pairEnergyCallback(moveList[i], &particles[moveList[i]].preMovePosition[0],
-                        particles[moveList[i]].preMoveType,
-                        pairInteractions[j], &particles[pairInteractions[j]].preMovePosition[0],particles[pairInteractions[j]].preMoveType);
-#endif
+                    energy = pairEnergies[j];
 
                     x = moveList[i];
                     y = pairInteractions[j];
@@ -527,6 +874,9 @@ namespace vmmc
                         // Store pair energy.
                         pairEnergyMatrix[x][y] = energy;
                     }
+
+                    // Pre-move pair energy with the environment.
+                    if (!particles[pairInteractions[j]].isMoving) initialEnergy += energy;
                 }
             }
         }
@@ -538,11 +888,69 @@ namespace vmmc
             for (unsigned int i=0;i<nMoving;i++)
             {
 #ifndef ISOTROPIC
-                excessEnergy -= callbacks.nonPairwiseCallback(moveList[i], &particles[moveList[i]].preMovePosition[0],
+                energy = callbacks.nonPairwiseCallback(moveList[i], &particles[moveList[i]].preMovePosition[0],
                     &particles[moveList[i]].preMoveOrientation[0]);
+                excessEnergy -= energy;
 #else
-                excessEnergy += callbacks.nonPairwiseCallback(moveList[i], &particles[moveList[i]].preMovePosition[0]);
+                energy = callbacks.nonPairwiseCallback(moveList[i], &particles[moveList[i]].preMovePosition[0]);
+                excessEnergy += energy;
 #endif
+                initialEnergy += energy;
+            }
+        }
+
+        if (!isRepusive)
+        {
+            // Pre-move pair energies with neighbours outside the cluster. Each was found
+            // when testing links, since these pairs interacted prior to the move.
+            for (unsigned int i=0;i<linkNeighbours.size();i++)
+            {
+                if (!particles[linkNeighbours[i]].isMoving)
+                    initialEnergy += linkEnergies[i];
+            }
+
+            // Links from the seed aren't tested for isotropic rotations, so find
+            // its pre-move energy with the environment directly.
+#ifndef ISOTROPIC
+            if (callbacks.isExternalEnergy && moveParams.isRotation && isIsotropic[moveParams.seed])
+            {
+                initialEnergy += callbacks.externalEnergyCallback(moveParams.seed, &particles[moveParams.seed].preMovePosition[0],
+                    particles[moveParams.seed].preMoveType, &particles[moveParams.seed].preMoveOrientation[0], &movingMask[0]);
+            }
+#else
+            if (callbacks.isExternalEnergy && moveParams.isRotation)
+            {
+                initialEnergy += callbacks.externalEnergyCallback(moveParams.seed, &particles[moveParams.seed].preMovePosition[0],
+                    particles[moveParams.seed].preMoveType, &movingMask[0]);
+            }
+#endif
+        }
+
+        // The external energy can't be split from the internal energy when using
+        // the particle energy callback, so find the pre-move energy directly.
+        // (Internal pair energies are unchanged by the rigid move, so cancel.)
+        if (!isRepusive && !callbacks.isExternalEnergy)
+        {
+            initialEnergy = 0;
+
+            for (unsigned int i=0;i<nMoving;i++)
+            {
+#ifndef ISOTROPIC
+                initialEnergy += callbacks.energyCallback(moveList[i], &particles[moveList[i]].preMovePosition[0],
+                    particles[moveList[i]].preMoveType, &particles[moveList[i]].preMoveOrientation[0]);
+#else
+                initialEnergy += callbacks.energyCallback(moveList[i], &particles[moveList[i]].preMovePosition[0],
+                    particles[moveList[i]].preMoveType);
+#endif
+                if (callbacks.isNonPairwise)
+                {
+#ifndef ISOTROPIC
+                    initialEnergy += callbacks.nonPairwiseCallback(moveList[i], &particles[moveList[i]].preMovePosition[0],
+                        &particles[moveList[i]].preMoveOrientation[0]);
+#else
+                    initialEnergy += callbacks.nonPairwiseCallback(moveList[i], &particles[moveList[i]].preMovePosition[0]);
+#endif
+                }
             }
         }
 
@@ -556,11 +964,13 @@ namespace vmmc
             if (callbacks.isNonPairwise)
             {
 #ifndef ISOTROPIC
-                excessEnergy += callbacks.nonPairwiseCallback(moveList[i], &particles[moveList[i]].preMovePosition[0],
+                energy = callbacks.nonPairwiseCallback(moveList[i], &particles[moveList[i]].preMovePosition[0],
                     &particles[moveList[i]].preMoveOrientation[0]);
 #else
-                excessEnergy += callbacks.nonPairwiseCallback(moveList[i], &particles[moveList[i]].preMovePosition[0]);
+                energy = callbacks.nonPairwiseCallback(moveList[i], &particles[moveList[i]].preMovePosition[0]);
 #endif
+                excessEnergy += energy;
+                finalEnergy += energy;
 
                 // Early exit for large non-pairwise energies.
                 if (excessEnergy > 1e6) return false;
@@ -568,44 +978,53 @@ namespace vmmc
 
             if (!isRepusive)
             {
+                // Pair energies within the rigid cluster are unchanged by the move,
+                // so only cluster-environment pairs need to be checked.
+                if (callbacks.isExternalEnergy)
+                {
 #ifndef ISOTROPIC
-                energy = callbacks.energyCallback(moveList[i], &particles[moveList[i]].preMovePosition[0],particles[moveList[i]].preMoveType, 
-                    &particles[moveList[i]].preMoveOrientation[0]);
+                    energy = callbacks.externalEnergyCallback(moveList[i], &particles[moveList[i]].preMovePosition[0],
+                        particles[moveList[i]].preMoveType, &particles[moveList[i]].preMoveOrientation[0], &movingMask[0]);
 #else
-                energy = callbacks.energyCallback(moveList[i], &particles[moveList[i]].preMovePosition[0],particles[moveList[i]].preMoveType);
+                    energy = callbacks.externalEnergyCallback(moveList[i], &particles[moveList[i]].preMovePosition[0],
+                        particles[moveList[i]].preMoveType, &movingMask[0]);
 #endif
+                }
+                else
+                {
+#ifndef ISOTROPIC
+                    energy = callbacks.energyCallback(moveList[i], &particles[moveList[i]].preMovePosition[0],particles[moveList[i]].preMoveType, 
+                        &particles[moveList[i]].preMoveOrientation[0]);
+#else
+                    energy = callbacks.energyCallback(moveList[i], &particles[moveList[i]].preMovePosition[0],particles[moveList[i]].preMoveType);
+#endif
+                }
 
                 // Overlap.
                 if (energy > 1e6) return false;
+
+                finalEnergy += energy;
             }
             else
             {
                 double x, y;
                 double pairEnergy;
                 unsigned int pairInteractions[maxInteractions];
+                double pairEnergies[maxInteractions];
 
-#ifndef ISOTROPIC
-                unsigned int nPairs = callbacks.interactionsCallback(moveList[i], &particles[moveList[i]].preMovePosition[0],
-                    &particles[moveList[i]].preMoveOrientation[0], pairInteractions);
-#else
-                unsigned int nPairs = callbacks.interactionsCallback(moveList[i],
-                    &particles[moveList[i]].preMovePosition[0], pairInteractions);
-#endif
+                // Get a list of pair interactions (and energies) following the move.
+                unsigned int nPairs = computeInteractions(moveList[i], pairInteractions, pairEnergies);
 
                 for (unsigned int j=0;j<nPairs;j++)
                 {
-#ifndef ISOTROPIC
-                    energy = callbacks.pairEnergyCallback(moveList[i], &particles[moveList[i]].preMovePosition[0], particles[moveList[i]].preMoveType, 
-                        &particles[moveList[i]].preMoveOrientation[0], pairInteractions[j],
-                        &particles[pairInteractions[j]].preMovePosition[0],particles[pairInteractions[j]].preMoveType,  &particles[pairInteractions[j]].preMoveOrientation[0]);
-#else
-                    energy = callbacks.pairEnergyCallback(moveList[i], &particles[moveList[i]].preMovePosition[0],particles[moveList[i]].preMoveType,
-                        pairInteractions[j], &particles[pairInteractions[j]].preMovePosition[0],particles[pairInteractions[j]].preMoveType);
-#endif
+                    energy = pairEnergies[j];
 
                     // Early exit test for hard core overlaps and large finite energy repulsions.
                     if (energy > 1e6) return false;
 
+                    // Pair energy with the environment.
+                    if (!particles[pairInteractions[j]].isMoving) finalEnergy += energy;
+
                     x = moveList[i];
                     y = pairInteractions[j];
 
@@ -647,55 +1066,39 @@ namespace vmmc
             if (rng() > exp(-excessEnergy)) return false;
         }
 
+        // Update the running total energy.
+        totalEnergy += finalEnergy - initialEnergy;
+
         // Move successful.
         return true;
     }
 
-    double VMMC::computeHydrodynamicRadius() const
+    double VMMC::computeHydrodynamicRadius(unsigned int clusterSize) const
     {
-        std::vector<double> centerOfMass(dimension);
-        std::vector<double> delta(dimension);
-
-        double hydroRadius = 0;
+        // N.B. The moments are accumulated relative to the seed as particles are
+        // recruited (see initiateParticle). For rotations the extent is measured
+        // from the seed, for translations from the cluster's center of mass.
+        double hydroRadius = secondMoment;
 
-        // Calculate center of mass of the moving cluster (translations only).
         if (!moveParams.isRotation)
         {
-            for (unsigned int i=0;i<nMoving;i++)
-            {
-                for (unsigned int j=0;j<dimension;j++)
-                    centerOfMass[j] += particles[moveList[i]].clusterPosition[j];
-            }
-        }
-
-        // Second pass to calculate the mean square extent perpendicular to motion.
-        for (unsigned int i=0;i<nMoving;i++)
-        {
-            if (!moveParams.isRotation)
-            {
-                for (unsigned int j=0;j<dimension;j++)
-                    delta[j] = particles[moveList[i]].clusterPosition[j] - centerOfMass[j] / (double) nMoving;
-            }
-            else
-            {
-                for (unsigned int j=0;j<dimension;j++)
-                    delta[j] = particles[moveList[i]].clusterPosition[j] - particles[moveParams.seed].preMovePosition[j];
-            }
-
-            double a1 = delta[0]*moveParams.trialVector[1] - delta[1]*moveParams.trialVector[0];
-            hydroRadius += a1*a1;
+            // Remove the center of mass contribution.
+            double a1 = firstMoment[0]*moveParams.trialVector[1] - firstMoment[1]*moveParams.trialVector[0];
+            double com = a1*a1;
 
             if (is3D)
             {
-                double a2 = delta[1]*moveParams.trialVector[2] - delta[2]*moveParams.trialVector[1];
-                double a3 = delta[2]*moveParams.trialVector[0] - delta[0]*moveParams.trialVector[2];
+                double a2 = firstMoment[1]*moveParams.trialVector[2] - firstMoment[2]*moveParams.trialVector[1];
+                double a3 = firstMoment[2]*moveParams.trialVector[0] - firstMoment[0]*moveParams.trialVector[2];
 
-                hydroRadius += a2*a2 + a3*a3;
+                com += a2*a2 + a3*a3;
             }
+
+            hydroRadius = std::max(hydroRadius - com / (double) nMoving, 0.0);
         }
 
         // Calculate scale factor from Stokes' law.
-        double rEff = referenceRadius + sqrt(hydroRadius / (double) nMoving);
+        double rEff = referenceRadius + sqrt(hydroRadius / (double) clusterSize);
         double scaleFactor = referenceRadius / rEff;
 
         // For rotations.
@@ -704,6 +1107,63 @@ namespace vmmc
         return scaleFactor;
     }
 
+    unsigned int VMMC::computeInteractions(unsigned int particle, unsigned int interactions[], double energies[])
+    {
+        unsigned int nPairs;
+
+        // Find the interactions and pair energies in a single neighbour search.
+        if (callbacks.isInteractionEnergies)
+        {
+#ifndef ISOTROPIC
+            nPairs = callbacks.interactionEnergiesCallback(particle, &particles[particle].preMovePosition[0],
+                particles[particle].preMoveType, &particles[particle].preMoveOrientation[0], interactions, energies, nullptr);
+#else
+            nPairs = callbacks.interactionEnergiesCallback(particle, &particles[particle].preMovePosition[0],
+                particles[particle].preMoveType, interactions, energies, nullptr);
+#endif
+        }
+        else
+        {
+#ifndef ISOTROPIC
+            nPairs = callbacks.interactionsCallback(particle, &particles[particle].preMovePosition[0],
+                &particles[particle].preMoveOrientation[0], interactions);
+#else
+            nPairs = callbacks.interactionsCallback(particle,
+                &particles[particle].preMovePosition[0], interactions);
+#endif
+
+            // Evaluate all pair energies in a single batch.
+            if (callbacks.isPairEnergies)
+            {
+#ifndef ISOTROPIC
+                callbacks.pairEnergiesCallback(particle, &particles[particle].preMovePosition[0],
+                    particles[particle].preMoveType, &particles[particle].preMoveOrientation[0], nPairs, interactions, energies);
+#else
+                callbacks.pairEnergiesCallback(particle, &particles[particle].preMovePosition[0],
+                    particles[particle].preMoveType, nPairs, interactions, energies);
+#endif
+                return nPairs;
+            }
+
+            for (unsigned int i=0;i<nPairs;i++)
+            {
+#ifndef ISOTROPIC
+                energies[i] = callbacks.pairEnergyCallback(particle,
+                    &particles[particle].preMovePosition[0], particles[particle].preMoveType,
+                    &particles[particle].preMoveOrientation[0], interactions[i],
+                    &particles[interactions[i]].preMovePosition[0], particles[interactions[i]].preMoveType,
+                    &particles[interactions[i]].preMoveOrientation[0]);
+#else
+                energies[i] = callbacks.pairEnergyCallback(particle, &particles[particle].preMovePosition[0],
+                    particles[particle].preMoveType, interactions[i],
+                    &particles[interactions[i]].preMovePosition[0], particles[interactions[i]].preMoveType);
+#endif
+            }
+        }
+
+        return nPairs;
+    }
+
     void VMMC::computePostMoveParticle(unsigned int particle, int direction, Particle& postMoveParticle)
     {
         // Initialise post-move position and orientation.
@@ -723,13 +1183,16 @@ namespace vmmc
             std::vector<double> v1(dimension);
             std::vector<double> v2(dimension);
 
+            // Rotation matrix for the direction of the move.
+            const std::vector<double>& matrix = (direction == 1) ?
+                moveParams.rotationMatrix : moveParams.reverseRotationMatrix;
+
             // Calculate coordinates relative to the global rotation point.
             for (unsigned int i=0;i<dimension;i++)
                 v1[i] = particles[particle].clusterPosition[i] - particles[moveParams.seed].clusterPosition[i];
 
             // Calculate position rotation vector.
-            if (is3D) rotate3D(v1, moveParams.trialVector, v2, direction*moveParams.stepSize);
-            else rotate2D(v1, v2, direction*moveParams.stepSize);
+            rotate(matrix, v1, v2);
 
             // Update position.
             for (unsigned int i=0;i<dimension;i++)
@@ -740,8 +1203,7 @@ namespace vmmc
             if (!isIsotropic[particle])
             {
                 // Calculate orientation rotation vector.
-                if (is3D) rotate3D(postMoveParticle.postMoveOrientation, moveParams.trialVector, v2, direction*moveParams.stepSize);
-                else rotate2D(postMoveParticle.postMoveOrientation, v2, direction*moveParams.stepSize);
+                rotate(matrix, postMoveParticle.postMoveOrientation, v2);
 
                 // Update orientation.
                 for (unsigned int i=0;i<dimension;i++)
@@ -753,6 +1215,17 @@ namespace vmmc
         // Only check forward move.
         if (direction == 1)
         {
+            // Particle has moved through a non-periodic boundary. Abort move!
+            for (unsigned int i=0;i<dimension;i++)
+            {
+                if (!isPeriodic[i] && ((postMoveParticle.postMovePosition[i] < 0) ||
+                    (postMoveParticle.postMovePosition[i] > boxSize[i])))
+                {
+                    isEarlyExit = true;
+                    return;
+                }
+            }
+
             // Check custom boundary condition.
             if (callbacks.isCustomBoundary)
             {
@@ -784,9 +1257,39 @@ namespace vmmc
 
         // Update move list.
         particles[particle].isMoving = true;
+        movingMask[particle] = 1;
         moveList[nMoving] = particle;
         nMoving++;
 
+        // Accumulate the moments of the cluster relative to the seed.
+        for (unsigned int i=0;i<dimension;i++)
+        {
+            delta[i] = particles[particle].clusterPosition[i] - particles[moveParams.seed].clusterPosition[i];
+            firstMoment[i] += delta[i];
+        }
+
+        double a1 = delta[0]*moveParams.trialVector[1] - delta[1]*moveParams.trialVector[0];
+        secondMoment += a1*a1;
+
+        if (is3D)
+        {
+            double a2 = delta[1]*moveParams.trialVector[2] - delta[2]*moveParams.trialVector[1];
+            double a3 = delta[2]*moveParams.trialVector[0] - delta[0]*moveParams.trialVector[2];
+
+            secondMoment += a2*a2 + a3*a3;
+        }
+
+        // The sum of squared extents can only grow as the cluster grows and the
+        // final cluster can be no larger than the cut-off (or the system), so the
+        // scale factor below is an upper bound on the final Stokes scale factor.
+        if (nMoving > 1)
+        {
+            unsigned int maxClusterSize = std::max(nMoving, std::min(cutOff, nParticles));
+
+            // Stokes drag rejection is guaranteed. Abort move!
+            if (stokesUniform > computeHydrodynamicRadius(maxClusterSize)) isEarlyExit = true;
+        }
+
         // See if particle was previously participating in a frustrated link.
         if (particles[particle].isFrustrated)
         {
@@ -809,70 +1312,144 @@ namespace vmmc
             // Abort if the cluster size cut-off is exceeded.
             if (nMoving <= cutOff)
             {
-                Particle reverseMoveParticle(dimension);
-
-                // Calculate coordinates under reverse trial move.
-                computePostMoveParticle(particle, -1, reverseMoveParticle);
+                // Coordinates under the reverse trial move. These are only needed
+                // once a link passes the forward test, so are computed lazily.
+                Particle reverseMoveParticle;
+                bool isReverseMove = false;
 
                 unsigned int pairInteractions[maxInteractions];
+                double pairEnergies[maxInteractions];
+                unsigned int nPairs;
 
-                // Get list of interactions.
+                // Get list of interactions, along with the pre-move pair energies if possible.
+                if (callbacks.isInteractionEnergies)
+                {
 #ifndef ISOTROPIC
-                unsigned int nPairs = callbacks.interactionsCallback(particle, &particles[particle].preMovePosition[0],
-                    &particles[particle].preMoveOrientation[0], pairInteractions);
+                    nPairs = callbacks.interactionEnergiesCallback(particle, &particles[particle].preMovePosition[0],
+                        particles[particle].preMoveType, &particles[particle].preMoveOrientation[0], pairInteractions, pairEnergies, nullptr);
 #else
-                unsigned int nPairs = callbacks.interactionsCallback(particle,
-                    &particles[particle].preMovePosition[0], pairInteractions);
+                    nPairs = callbacks.interactionEnergiesCallback(particle, &particles[particle].preMovePosition[0],
+                        particles[particle].preMoveType, pairInteractions, pairEnergies, nullptr);
 #endif
+                }
+                else
+                {
+#ifndef ISOTROPIC
+                    nPairs = callbacks.interactionsCallback(particle, &particles[particle].preMovePosition[0],
+                        &particles[particle].preMoveOrientation[0], pairInteractions);
+#else
+                    nPairs = callbacks.interactionsCallback(particle,
+                        &particles[particle].preMovePosition[0], pairInteractions);
+#endif
+                }
 
-                // Loop over all interactions.
-                for (unsigned int i=0;i<nPairs;i++)
+                // Loop over all interactions (stopping if an early exit condition is triggered).
+                for (unsigned int i=0;i<nPairs && !isEarlyExit;i++)
                 {
                     unsigned int neighbour = pairInteractions[i];
 
                     // Make sure link hasn't been tested already.
                     if (!particles[neighbour].isMoving)
                     {
-                        // Pre-move pair energy.
+                        double initialEnergy, finalEnergy, reverseMoveEnergy;
+                        bool isReverseMoveEnergy = false;
+
+                        if (callbacks.isPairEnergy3)
+                        {
+                            // Evaluate the pre- and post-move pair energies in a single call, along
+                            // with the reverse move pair energy if it has already been computed.
+                            // The pre-move energy is skipped if it was found with the interactions.
+                            unsigned int first = callbacks.isInteractionEnergies ? 1 : 0;
+                            unsigned int nConfigurations = isReverseMove ? 3 : 2;
+                            double energies[3];
+
+                            const double* positions[3] = { &particles[particle].preMovePosition[0],
+                                &particles[particle].postMovePosition[0], nullptr };
+                            if (isReverseMove) positions[2] = &reverseMoveParticle.postMovePosition[0];
 #ifndef ISOTROPIC
-                        double initialEnergy = callbacks.pairEnergyCallback(particle,
-                            &particles[particle].preMovePosition[0], &particles[particle].preMoveOrientation[0],particles[particle].preMoveType,
-                            neighbour, &particles[neighbour].preMovePosition[0],particles[nieghbour].preMoveType, &particles[neighbour].preMoveOrientation[0]);
+                            const double* orientations[3] = { &particles[particle].preMoveOrientation[0],
+                                &particles[particle].postMoveOrientation[0], nullptr };
+                            if (isReverseMove) orientations[2] = &reverseMoveParticle.postMoveOrientation[0];
+
+                            callbacks.pairEnergy3Callback(particle, positions + first, particles[particle].preMoveType, orientations + first,
+                                nConfigurations - first, neighbour, &particles[neighbour].preMovePosition[0], particles[neighbour].preMoveType,
+                                &particles[neighbour].preMoveOrientation[0], energies + first);
 #else
-                        double initialEnergy = callbacks.pairEnergyCallback(particle, &particles[particle].preMovePosition[0],particles[particle].preMoveType,
-                            neighbour, &particles[neighbour].preMovePosition[0],particles[neighbour].preMoveType);
+                            callbacks.pairEnergy3Callback(particle, positions + first, particles[particle].preMoveType, nConfigurations - first,
+                                neighbour, &particles[neighbour].preMovePosition[0], particles[neighbour].preMoveType, energies + first);
 #endif
 
-                        // Post-move pair energy.
+                            initialEnergy = first ? pairEnergies[i] : energies[0];
+                            finalEnergy = energies[1];
+                            reverseMoveEnergy = energies[2];
+                            isReverseMoveEnergy = isReverseMove;
+                        }
+                        else
+                        {
+                            // Pre-move pair energy.
+                            if (callbacks.isInteractionEnergies) initialEnergy = pairEnergies[i];
+                            else
+                            {
 #ifndef ISOTROPIC
-                        double finalEnergy = callbacks.pairEnergyCallback(particle,
-                            &particles[particle].postMovePosition[0],particles[particle].postMoveType, &particles[particle].postMoveOrientation[0],
-                            neighbour, &particles[neighbour].preMovePosition[0],particles[neighbour].postMoveType, &particles[neighbour].preMoveOrientation[0]);
+                                initialEnergy = callbacks.pairEnergyCallback(particle,
+                                    &particles[particle].preMovePosition[0], particles[particle].preMoveType, &particles[particle].preMoveOrientation[0],
+                                    neighbour, &particles[neighbour].preMovePosition[0], particles[neighbour].preMoveType, &particles[neighbour].preMoveOrientation[0]);
 #else
-                        double finalEnergy = callbacks.pairEnergyCallback(particle, &particles[particle].postMovePosition[0],particles[particle].postMoveType, 
-                            neighbour, &particles[neighbour].preMovePosition[0],particles[neighbour].postMoveType);
+                                initialEnergy = callbacks.pairEnergyCallback(particle, &particles[particle].preMovePosition[0], particles[particle].preMoveType,
+                                    neighbour, &particles[neighbour].preMovePosition[0], particles[neighbour].preMoveType);
 #endif
+                            }
 
-                        // Pair energy following the reverse virtual move.
+                            // Post-move pair energy.
 #ifndef ISOTROPIC
-                        double reverseMoveEnergy = callbacks.pairEnergyCallback(particle,
-                            &reverseMoveParticle.postMovePosition[0], reverseMoveParticle.postMoveType, &reverseMoveParticle.postMoveOrientation[0],
-                            neighbour, &particles[neighbour].preMovePosition[0],particles[neighbour].preMoveType, &particles[neighbour].preMoveOrientation[0]);
+                            finalEnergy = callbacks.pairEnergyCallback(particle,
+                                &particles[particle].postMovePosition[0], particles[particle].postMoveType, &particles[particle].postMoveOrientation[0],
+                                neighbour, &particles[neighbour].preMovePosition[0], particles[neighbour].preMoveType, &particles[neighbour].preMoveOrientation[0]);
 #else
-                        double reverseMoveEnergy = callbacks.pairEnergyCallback(particle, &reverseMoveParticle.postMovePosition[0],reverseMoveParticle.postMoveType,
-                            neighbour, &particles[neighbour].preMovePosition[0],particles[neighbour].preMoveType);
+                            finalEnergy = callbacks.pairEnergyCallback(particle, &particles[particle].postMovePosition[0], particles[particle].postMoveType,
+                                neighbour, &particles[neighbour].preMovePosition[0], particles[neighbour].preMoveType);
 #endif
+                        }
+
+                        // Store the pre-move pair energy (for the energy change of the move).
+                        if (!isRepusive)
+                        {
+                            linkNeighbours.push_back(neighbour);
+                            linkEnergies.push_back(initialEnergy);
+                        }
 
                         // Forward link weight.
                         double linkWeight = std::max(1.0-exp(initialEnergy-finalEnergy),0.0);
 
-                        // Reverse link weight.
-                        double reverseLinkWeight = std::max(1.0-exp(initialEnergy-reverseMoveEnergy),0.0);
-
-                        // Test links.
-                        if (rng() <= linkWeight)
+                        // Test forward link. (A zero weight link can never form.)
+                        if (linkWeight > 0 && rng() <= linkWeight)
                         {
-                            if (rng() > reverseLinkWeight/linkWeight)
+                            // Reverse move pair energy is yet to be evaluated.
+                            if (!isReverseMoveEnergy)
+                            {
+                                // Calculate coordinates under reverse trial move.
+                                if (!isReverseMove)
+                                {
+                                    computePostMoveParticle(particle, -1, reverseMoveParticle);
+                                    isReverseMove = true;
+                                }
+
+                                // Pair energy following the reverse virtual move.
+#ifndef ISOTROPIC
+                                reverseMoveEnergy = callbacks.pairEnergyCallback(particle,
+                                    &reverseMoveParticle.postMovePosition[0], reverseMoveParticle.postMoveType, &reverseMoveParticle.postMoveOrientation[0],
+                                    neighbour, &particles[neighbour].preMovePosition[0],particles[neighbour].preMoveType, &particles[neighbour].preMoveOrientation[0]);
+#else
+                                reverseMoveEnergy = callbacks.pairEnergyCallback(particle, &reverseMoveParticle.postMovePosition[0],reverseMoveParticle.postMoveType,
+                                    neighbour, &particles[neighbour].preMovePosition[0],particles[neighbour].preMoveType);
+#endif
+                            }
+
+                            // Reverse link weight.
+                            double reverseLinkWeight = std::max(1.0-exp(initialEnergy-reverseMoveEnergy),0.0);
+
+                            // Test reverse link. (No draw is needed if the link is certain to form.)
+                            if (reverseLinkWeight < linkWeight && rng() > reverseLinkWeight/linkWeight)
                             {
                                 // Particle isn't already participating in a frustrated link.
                                 if (!particles[neighbour].isFrustrated)
@@ -918,25 +1495,191 @@ namespace vmmc
 #endif
     }
 
-    void VMMC::rotate3D(std::vector<double>& v1, std::vector<double>& v2, std::vector<double>& v3, double angle)
+    void VMMC::computeRotationMatrix(double angle, std::vector<double>& matrix)
     {
         double c = cos(angle);
         double s = sin(angle);
 
-        double v1Dotv2 = v1[0]*v2[0] + v1[1]*v2[1] + v1[2]*v2[2];
+        if (is3D)
+        {
+            const std::vector<double>& v = moveParams.trialVector;
+
+            matrix[0] = c + (1 - c)*v[0]*v[0];
+            matrix[1] = (1 - c)*v[0]*v[1] + s*v[2];
+            matrix[2] = (1 - c)*v[0]*v[2] - s*v[1];
+            matrix[3] = (1 - c)*v[1]*v[0] - s*v[2];
+            matrix[4] = c + (1 - c)*v[1]*v[1];
+            matrix[5] = (1 - c)*v[1]*v[2] + s*v[0];
+            matrix[6] = (1 - c)*v[2]*v[0] + s*v[1];
+            matrix[7] = (1 - c)*v[2]*v[1] - s*v[0];
+            matrix[8] = c + (1 - c)*v[2]*v[2];
+        }
+        else
+        {
+            matrix[0] = c;
+            matrix[1] = -s;
+            matrix[2] = s;
+            matrix[3] = c;
+        }
+    }
 
-        v3[0] = ((v1[0] - v2[0]*v1Dotv2))*(c - 1) + (v2[2]*v1[1] - v2[1]*v1[2])*s;
-        v3[1] = ((v1[1] - v2[1]*v1Dotv2))*(c - 1) + (v2[0]*v1[2] - v2[2]*v1[0])*s;
-        v3[2] = ((v1[2] - v2[2]*v1Dotv2))*(c - 1) + (v2[1]*v1[0] - v2[0]*v1[1])*s;
+    void VMMC::rotate(const std::vector<double>& matrix, const std::vector<double>& v1, std::vector<double>& v2)
+    {
+        if (is3D)
+        {
+            v2[0] = matrix[0]*v1[0] + matrix[1]*v1[1] + matrix[2]*v1[2] - v1[0];
+            v2[1] = matrix[3]*v1[0] + matrix[4]*v1[1] + matrix[5]*v1[2] - v1[1];
+            v2[2] = matrix[6]*v1[0] + matrix[7]*v1[1] + matrix[8]*v1[2] - v1[2];
+        }
+        else
+        {
+            v2[0] = matrix[0]*v1[0] + matrix[1]*v1[1] - v1[0];
+            v2[1] = matrix[2]*v1[0] + matrix[3]*v1[1] - v1[1];
+        }
     }
 
-    void VMMC::rotate2D(std::vector<double>& v1, std::vector<double>& v2, double angle)
+    bool VMMC::computeClusters(std::vector<unsigned int>& clusterIndex, std::vector<unsigned int>& members,
+        std::vector<unsigned int>& clusterStart, std::vector<double>& unwrapped, std::vector<double>& centres)
     {
-        double c = cos(angle);
-        double s = sin(angle);
+        clusterIndex.assign(nParticles, nParticles);
+        members.clear();
+        clusterStart.clear();
+        unwrapped.resize(dimension*nParticles);
+        centres.clear();
+
+        std::vector<double> sep(dimension);
+        std::vector<unsigned int> pairInteractions(maxInteractions);
+
+        for (unsigned int i=0;i<nParticles;i++)
+        {
+            // Skip dead particles and those already assigned to a cluster.
+            if (particles[i].preMoveType == 0 || clusterIndex[i] != nParticles) continue;
+
+            unsigned int cluster = clusterStart.size();
+            unsigned int first = members.size();
+
+            clusterStart.push_back(first);
+            clusterIndex[i] = cluster;
+            members.push_back(i);
+
+            for (unsigned int j=0;j<dimension;j++)
+                unwrapped[dimension*i + j] = particles[i].preMovePosition[j];
+
+            // Breadth-first search of the interaction network (the member list is the queue).
+            for (unsigned int j=first;j<members.size();j++)
+            {
+                unsigned int particle = members[j];
+
+#ifndef ISOTROPIC
+                unsigned int nPairs = callbacks.interactionsCallback(particle, &particles[particle].preMovePosition[0],
+                    &particles[particle].preMoveOrientation[0], &pairInteractions[0]);
+#else
+                unsigned int nPairs = callbacks.interactionsCallback(particle,
+                    &particles[particle].preMovePosition[0], &pairInteractions[0]);
+#endif
+
+                for (unsigned int k=0;k<nPairs;k++)
+                {
+                    unsigned int neighbour = pairInteractions[k];
+
+                    if (particles[neighbour].preMoveType == 0) continue;
+
+                    computeSeparation(particles[particle].preMovePosition, particles[neighbour].preMovePosition, sep);
+
+                    if (clusterIndex[neighbour] == nParticles)
+                    {
+                        clusterIndex[neighbour] = cluster;
+                        members.push_back(neighbour);
+
+                        for (unsigned int l=0;l<dimension;l++)
+                            unwrapped[dimension*neighbour + l] = unwrapped[dimension*particle + l] + sep[l];
+                    }
+                    else
+                    {
+                        // Reaching a member through a different periodic image means
+                        // that the cluster spans the box and can't be rescaled rigidly.
+                        for (unsigned int l=0;l<dimension;l++)
+                        {
+                            if (std::abs(unwrapped[dimension*neighbour + l]
+                                - unwrapped[dimension*particle + l] - sep[l]) > 0.5*boxSize[l]) return false;
+                        }
+                    }
+                }
+            }
+
+            // Compute the centre of mass of the cluster.
+            unsigned int size = members.size() - first;
+
+            for (unsigned int j=0;j<dimension;j++)
+            {
+                double centre = 0;
+                for (unsigned int k=first;k<members.size();k++)
+                    centre += unwrapped[dimension*members[k] + j];
+
+                centres.push_back(centre/size);
+            }
+        }
+
+        clusterStart.push_back(members.size());
 
-        v2[0] = (v1[0]*c - v1[1]*s) - v1[0];
-        v2[1] = (v1[0]*s + v1[1]*c) - v1[1];
+        return true;
+    }
+
+    double VMMC::computeNonPairwiseEnergy(const std::vector<unsigned int>& members)
+    {
+        double energy = 0;
+
+        for (unsigned int i=0;i<members.size();i++)
+        {
+            unsigned int particle = members[i];
+#ifndef ISOTROPIC
+            energy += callbacks.nonPairwiseCallback(particle, &particles[particle].preMovePosition[0],
+                &particles[particle].preMoveOrientation[0]);
+#else
+            energy += callbacks.nonPairwiseCallback(particle, &particles[particle].preMovePosition[0]);
+#endif
+        }
+
+        return energy;
+    }
+
+    bool VMMC::isInterClusterInteraction(const std::vector<unsigned int>& clusterIndex,
+        const std::vector<double>& unwrapped)
+    {
+        std::vector<double> sep(dimension);
+        std::vector<unsigned int> pairInteractions(maxInteractions);
+
+        for (unsigned int i=0;i<nParticles;i++)
+        {
+            if (clusterIndex[i] == nParticles) continue;
+
+#ifndef ISOTROPIC
+            unsigned int nPairs = callbacks.interactionsCallback(i, &particles[i].preMovePosition[0],
+                &particles[i].preMoveOrientation[0], &pairInteractions[0]);
+#else
+            unsigned int nPairs = callbacks.interactionsCallback(i, &particles[i].preMovePosition[0], &pairInteractions[0]);
+#endif
+
+            for (unsigned int j=0;j<nPairs;j++)
+            {
+                unsigned int neighbour = pairInteractions[j];
+
+                if (clusterIndex[neighbour] == nParticles) continue;
+
+                if (clusterIndex[neighbour] != clusterIndex[i]) return true;
+
+                // Members of the same cluster must interact through the same image.
+                computeSeparation(particles[i].preMovePosition, particles[neighbour].preMovePosition, sep);
+
+                for (unsigned int k=0;k<dimension;k++)
+                {
+                    if (std::abs(unwrapped[dimension*neighbour + k]
+                        - unwrapped[dimension*i + k] - sep[k]) > 0.5*boxSize[k]) return true;
+                }
+            }
+        }
+
+        return false;
     }
 
     void VMMC::computeSeparation(std::vector<double>& v1, std::vector<double>& v2, std::vector<double>& sep)
@@ -945,6 +1688,9 @@ namespace vmmc
         {
             sep[i] = v2[i] - v1[i];
 
+            // No minimum image across non-periodic boundaries.
+            if (!isPeriodic[i]) continue;
+
             if (sep[i] < -0.5*boxSize[i])
             {
                 sep[i] += boxSize[i];
@@ -963,6 +1709,9 @@ namespace vmmc
     {
         for (unsigned int i=0;i<vec.size();i++)
         {
+            // Only wrap across periodic boundaries.
+            if (!isPeriodic[i]) continue;
+
             if (vec[i] < 0)
             {
                 vec[i] += boxSize[i];
@@ -986,4 +1735,25 @@ namespace vmmc
 
         return sqrt(normSquared);
     }
+
+    unsigned long long VMMC::computeMortonCode(const std::vector<double>& vec) const
+    {
+        // Number of bits per axis.
+        const unsigned int nBits = is3D ? 21 : 32;
+
+        unsigned long long code = 0;
+
+        for (unsigned int i=0;i<dimension;i++)
+        {
+            // Integer coordinate along the axis.
+            unsigned long long x = (unsigned long long) ((vec[i] / boxSize[i]) * (1ULL << nBits));
+            if (x >= (1ULL << nBits)) x = (1ULL << nBits) - 1;
+
+            // Interleave the bits.
+            for (unsigned int j=0;j<nBits;j++)
+                code |= ((x >> j) & 1ULL) << (dimension*j + i);
+        }
+
+        return code;
+    }
 }
@@ -58,6 +58,31 @@ namespace vmmc
     typedef std::function<double (unsigned int, const double*,unsigned int)> EnergyCallback;
 #endif
 
+    //! Calculate the energy between a particle and all particles outside the moving cluster.
+    /*! \param index
+            The particle index.
+
+        \param position
+            The position of the particle.
+
+        \param type
+            The type of the particle.
+
+        \param orientation
+            The orientation of the particle.
+
+        \param isMoving
+            Mask of particle indices, non-zero if the particle is part of the moving cluster.
+
+        \return
+            The interaction energy felt by the particle due to non-moving neighbours.
+    */
+#ifndef ISOTROPIC
+    typedef std::function<double (unsigned int, const double*, unsigned int, const double*, const char*)> ExternalEnergyCallback;
+#else
+    typedef std::function<double (unsigned int, const double*, unsigned int, const char*)> ExternalEnergyCallback;
+#endif
+
     //! Calculate the pair energy between two particles.
     /*! \param particle1
             The index of the first particle.
@@ -86,6 +111,48 @@ namespace vmmc
     typedef std::function<double (unsigned int, const double*, unsigned int,unsigned int, const double*, unsigned int)> PairEnergyCallback;
 #endif
 
+    //! Calculate the pair energy between two particles for several configurations of the first particle.
+    /*! This is used to test links, where the same pair is evaluated before the move,
+        following the move and (when needed) following the reverse move.
+
+        \param particle1
+            The index of the first particle.
+
+        \param positions1
+            An array of pointers to the positions of the first particle.
+
+        \param type1
+            The type of the first particle.
+
+        \param orientations1
+            An array of pointers to the orientations of the first particle.
+
+        \param nConfigurations
+            The number of configurations of the first particle (at most three).
+
+        \param particle2
+            The index of the second particle.
+
+        \param position2
+            The position of the second particle.
+
+        \param type2
+            The type of the second particle.
+
+        \param orientation2
+            The orientation of the second particle.
+
+        \param energies
+            An array to store the pair energy for each configuration.
+    */
+#ifndef ISOTROPIC
+    typedef std::function<void (unsigned int, const double* const*, unsigned int, const double* const*, unsigned int,
+        unsigned int, const double*, unsigned int, const double*, double*)> PairEnergy3Callback;
+#else
+    typedef std::function<void (unsigned int, const double* const*, unsigned int, unsigned int,
+        unsigned int, const double*, unsigned int, double*)> PairEnergy3Callback;
+#endif
+
     //! Determine the interactions for a particle.
     /*! \param index
             The particle index.
@@ -108,6 +175,65 @@ namespace vmmc
     typedef std::function<unsigned int (unsigned int, const double*, unsigned int[])> InteractionsCallback;
 #endif
 
+    //! Determine the interactions for a particle along with the corresponding pair energies.
+    /*! \param index
+            The particle index.
+
+        \param position
+            The position of the particle.
+
+        \param type
+            The type of the particle.
+
+        \param orientation
+            The orientation of the particle.
+
+        \param interactions
+            An array to store the indices of neighbours with which the particle interacts.
+
+        \param energies
+            An array to store the pair energy for each interaction.
+
+        \param squaredDistances
+            An array to store the squared separation for each interaction (may be null).
+
+        \return
+            The number of interactions.
+    */
+#ifndef ISOTROPIC
+    typedef std::function<unsigned int (unsigned int, const double*, unsigned int, const double*, unsigned int[], double[], double[])> InteractionEnergiesCallback;
+#else
+    typedef std::function<unsigned int (unsigned int, const double*, unsigned int, unsigned int[], double[], double[])> InteractionEnergiesCallback;
+#endif
+
+    //! Calculate the pair energies between a particle and a list of neighbours in a single batch.
+    /*! \param index
+            The particle index.
+
+        \param position
+            The position of the particle.
+
+        \param type
+            The type of the particle.
+
+        \param orientation
+            The orientation of the particle.
+
+        \param nNeighbours
+            The number of neighbours.
+
+        \param neighbours
+            The indices of the neighbours.
+
+        \param energies
+            An array to store the pair energy with each neighbour.
+    */
+#ifndef ISOTROPIC
+    typedef std::function<void (unsigned int, const double*, unsigned int, const double*, unsigned int, const unsigned int*, double*)> PairEnergiesCallback;
+#else
+    typedef std::function<void (unsigned int, const double*, unsigned int, unsigned int, const unsigned int*, double*)> PairEnergiesCallback;
+#endif
+
     //! Apply any post-move updates for a given particle.
     /*! \param index
             The particle index.
@@ -162,6 +288,22 @@ namespace vmmc
     typedef std::function<bool (unsigned int, const double*)> BoundaryCallback;
 #endif
 
+    //! Reorder callback function prototype.
+    /*! \param order
+            The new particle ordering: order[i] is the previous index of the
+            particle that now has index i.
+     */
+    typedef std::function<void (const unsigned int*)> ReorderCallback;
+
+    //! Volume change callback function prototype.
+    /*! \param boxSize
+            The new size of the simulation box in each dimension.
+
+        \param coordinates
+            The coordinates of all particles in the rescaled box.
+     */
+    typedef std::function<void (const double*, const double*)> VolumeChangeCallback;
+
     // DATA TYPES
 
     //! Container for storing virtual move parameters.
@@ -171,6 +313,8 @@ namespace vmmc
         bool isRotation;                            //!< Whether the move is a rotation.
         double stepSize;                            //!< The magnitude of the trial move.
         std::vector<double> trialVector;            //!< Vector for trial move.
+        std::vector<double> rotationMatrix;         //!< Rotation matrix for the forward move (row major).
+        std::vector<double> reverseRotationMatrix;  //!< Rotation matrix for the reverse move (row major).
     };
 
     //! Container for storing particle attributes during the virtual move.
@@ -205,14 +349,26 @@ namespace vmmc
     struct CallbackFunctions
     {
         EnergyCallback energyCallback;              //!< Callback function to calculate particle energies.
+        ExternalEnergyCallback externalEnergyCallback;  //!< Callback function to calculate cluster-environment energies (optional).
         PairEnergyCallback pairEnergyCallback;      //!< Callback function to calculate pair energies.
+        PairEnergy3Callback pairEnergy3Callback;    //!< Callback function to calculate multi-configuration pair energies (optional).
         InteractionsCallback interactionsCallback;  //!< Callback function to determine particle interactions.
+        InteractionEnergiesCallback interactionEnergiesCallback;    //!< Callback function to determine interactions and pair energies (optional).
+        PairEnergiesCallback pairEnergiesCallback;  //!< Callback function to calculate batches of pair energies (optional).
         PostMoveCallback postMoveCallback;          //!< Callback function to apply any post-move updates.
         NonPairwiseCallback nonPairwiseCallback;    //!< Callback function to calculate non-pairwise interaction energies.
         BoundaryCallback boundaryCallback;          //!< Callback function to apply custom boundary conditions.
+        ReorderCallback reorderCallback;            //!< Callback function to permute model particle storage (optional).
+        VolumeChangeCallback volumeChangeCallback;  //!< Callback function to apply a change in box size (optional).
 
         bool isNonPairwise;                         //!< Whether the non-pairwise energy callback is defined.
         bool isCustomBoundary;                      //!< Whether the boundary callback is defined.
+        bool isExternalEnergy;                      //!< Whether the external energy callback is defined.
+        bool isPairEnergy3;                         //!< Whether the multi-configuration pair energy callback is defined.
+        bool isInteractionEnergies;                 //!< Whether the interaction energies callback is defined.
+        bool isPairEnergies;                        //!< Whether the batch pair energies callback is defined.
+        bool isReorder;                             //!< Whether the reorder callback is defined.
+        bool isVolumeChange;                        //!< Whether the volume change callback is defined.
     };
 
     //! Main VMMC class.
@@ -266,6 +422,56 @@ namespace vmmc
 #endif
             const CallbackFunctions&);
 
+        //! Constructor: simulation box with defined periodicity.
+        /*! \param nParticles_
+                The number of particles in the simulation box.
+
+            \param dimension_
+                The dimension of the simulation box.
+
+            \param coordinates
+                The coordinates of all particles in the system.
+
+            \param orientations
+                The orientations of all particle in the system.
+
+            \param maxTrialTranslation_
+                The maximum trial translation (in units of the reference particle diameter).
+
+            \param maxTrialRotation_
+                The maximum trial rotation.
+
+            \param probTranslate_
+                The probability of performing a translation move (versus a rotation).
+
+            \param referenceRadius_
+                Reference particle radius (for Stokes scaling).
+
+            \param maxInteractions_
+                Maximum number of interactions per particle.
+
+            \param boxSize_
+                The size of the simulation box in each dimension.
+
+            \param isPeriodic_
+                Whether the simulation box is periodic in each dimension.
+
+            \param isIsotropic_
+                Whether the potential of each particle is isotropic.
+
+            \param isRepusive_
+                Whether there are finite repulsive interactions.
+
+            \param callbacks_
+                Callback function container.
+        */
+#ifndef ISOTROPIC
+        VMMC(unsigned int, unsigned int, double*,int*, double*, double, double, double, double, unsigned int, double*, bool*, bool*, bool,
+#else
+        VMMC(unsigned int, unsigned int, double*,int*, double, double, double, double, unsigned int, double*, bool*, bool,
+#endif
+            const CallbackFunctions&);
+
         //! Overloaded ++ operator. Perform a single VMMC step.
         void operator ++ (const int);
 
@@ -323,9 +529,108 @@ namespace vmmc
         */
         const std::vector<unsigned long long>& getClusterRotations() const;
 
+        //! Get the number of attempted volume moves.
+        /*! \return
+                The number of attempted volume moves.
+        */
+        unsigned long long getVolumeAttempts() const;
+
+        //! Get the number of accepted volume moves.
+        /*! \return
+                The number of accepted volume moves.
+        */
+        unsigned long long getVolumeAccepts() const;
+
+        //! Get the size of the simulation box.
+        /*! \return
+                A const reference to the box size vector.
+        */
+        const std::vector<double>& getBoxSize() const;
+
         //! Reset statistics.
         void reset();
 
+        //! Get the total energy of the system.
+        /*! The energy is found once, on construction, then updated with the
+            energy change of each accepted move (including volume moves), so
+            this is O(1). The total includes any non-pairwise energy.
+
+            \return
+                The total energy (in units of kBT).
+         */
+        double getEnergy() const;
+
+        //! Compute the total energy of the system from scratch.
+        /*! The running total is reset to the result, e.g. after particles
+            have been moved outside of VMMC.
+
+            \return
+                The total energy (in units of kBT).
+         */
+        double computeEnergy();
+
+        //! Periodically check the running total energy against a full recomputation.
+        /*! The running total is reset to the recomputed energy after each check.
+            A drift larger than the tolerance is an error, since it means that
+            the callbacks are inconsistent with each other.
+
+            \param interval
+                The number of attempted moves between checks (zero to disable).
+
+            \param tolerance
+                The maximum drift, relative to max(1, |energy|).
+         */
+        void setEnergyCheck(unsigned long long, double);
+
+        //! Get the largest drift in the running total energy found by a check.
+        /*! \return
+                The largest absolute drift.
+         */
+        double getEnergyDrift() const;
+
+        //! Attempt an isobaric volume move.
+        /*! Clusters of interacting particles are translated rigidly with their
+            centre of mass, so bound aggregates are never torn apart. The move is
+            rejected if any pair of particles in different clusters would start to
+            interact, hence only pairs that cross the interaction threshold need
+            to be considered. The volume change callback is used to keep the box
+            size of the model in sync. Requires a fully periodic box.
+
+            \param pressure
+                The pressure (in units of kBT per unit volume).
+
+            \param maxVolumeChange
+                The maximum trial change in volume.
+
+            \return
+                Whether the move was accepted.
+         */
+        bool volumeMove(double, double);
+
+        //! Reorder particles along a Morton (Z-order) space-filling curve.
+        /*! Particles that are close in space end up close in memory, which
+            improves the locality of neighbour accesses. The reorder callback,
+            which is required, is used to apply the same permutation to the
+            particle storage of the model. Call this between moves, e.g. every
+            few sweeps.
+         */
+        void reorder();
+
+        //! Get the external index of a particle, i.e. its index before any reordering.
+        /*! \param particle
+                The current particle index.
+
+            \return
+                The external particle index.
+         */
+        unsigned int getExternalIndex(unsigned int) const;
+
+        //! Get the external index of all particles.
+        /*! \return
+                A const reference to the external index vector.
+         */
+        const std::vector<unsigned int>& getExternalIndices() const;
+
         MersenneTwister rng;                        //!< Random number generator.
 
     private:
@@ -333,6 +638,13 @@ namespace vmmc
         unsigned long long nAttempts;               //!< Number of attempted moves.
         unsigned long long nAccepts;                //!< Number of accepted moves.
         unsigned long long nRotations;              //!< Number of accepted rotations.
+        unsigned long long nVolumeAttempts;         //!< Number of attempted volume moves.
+        unsigned long long nVolumeAccepts;          //!< Number of accepted volume moves.
+
+        double totalEnergy;                         //!< The total energy (maintained incrementally).
+        unsigned long long energyCheckInterval;     //!< The number of attempted moves between energy checks (zero if disabled).
+        double energyTolerance;                     //!< The relative tolerance for energy drift.
+        double energyDrift;                         //!< The largest energy drift found by a check.
 
         unsigned int nParticles;                    //!< The number of particles in the simulation box.
         unsigned int dimension;                     //!< The dimension of the simulation box.
@@ -342,6 +654,7 @@ namespace vmmc
         double referenceRadius;                     //!< Reference particle radius (for Stokes scaling).
         unsigned int maxInteractions;               //!< Maximum number of interactions per particle.
         std::vector<double> boxSize;                //!< The size of the simulation box in each dimension.
+        std::vector<bool> isPeriodic;               //!< Whether the simulation box is periodic in each dimension.
 #ifndef ISOTROPIC
         std::vector<bool> isIsotropic;              //!< Whether the potential of each particle is isotropic.
 #endif
@@ -351,9 +664,11 @@ namespace vmmc
         CallbackFunctions callbacks;                //!< Callback functions.
 
         std::vector<Particle> particles;            //!< Vector of particles.
+        std::vector<unsigned int> externalIndices;  //!< External index of each particle (before any reordering).
 
         unsigned int nMoving;                                   //!< The number of particles in the cluster.
         std::vector<unsigned int> moveList;                     //!< the indices of particles in the cluster.
+        std::vector<char> movingMask;                           //!< Contiguous copy of the isMoving flags (for callbacks).
         std::vector<unsigned long long> clusterTranslations;    //!< Array for storing the number of translations for each cluster size.
         std::vector<unsigned long long> clusterRotations;       //!< Array for storing the number of rotations for each cluster size
 
@@ -364,6 +679,13 @@ namespace vmmc
         std::vector<std::vector<unsigned int> > interactions;   //!< Indices of particle pairs that interact in the cluster.
         std::vector<std::vector<double> > pairEnergyMatrix;     //!< Pair energies for particle interactions in the cluster.
 
+        std::vector<unsigned int> linkNeighbours;               //!< Neighbours tested for links while building the cluster.
+        std::vector<double> linkEnergies;                       //!< Pre-move pair energy of each tested link.
+
+        std::vector<double> firstMoment;            //!< Running sum of cluster positions (relative to the seed).
+        double secondMoment;                        //!< Running sum of squared extents perpendicular to the trial vector.
+        double stokesUniform;                       //!< Pre-drawn uniform random number for the Stokes drag test.
+
         unsigned int cutOff;                        //!< The cut-off cluster size for the trial move.
         bool isEarlyExit;                           //!< Whether trial move aborted early.
 
@@ -373,8 +695,77 @@ namespace vmmc
         //! Determine whether move is accepted.
         bool accept();
 
-        //! Compute the hydrodynamic radius of the moving cluster.
-        double computeHydrodynamicRadius() const;
+        //! Compare the running total energy with a full recomputation (then resynchronise).
+        void checkEnergy();
+
+        //! Compute the Stokes scaling factor from the hydrodynamic radius of the moving cluster.
+        /*! \param clusterSize
+                The cluster size used to normalise the mean square extent. Passing an
+                upper bound on the final cluster size gives an upper bound on the final
+                scaling factor.
+
+            \return
+                The Stokes scaling factor.
+        */
+        double computeHydrodynamicRadius(unsigned int) const;
+
+        //! Determine the interactions and pair energies for a particle in its current state.
+        /*! \param particle
+                Index of the particle.
+
+            \param interactions
+                An array to store the indices of the interacting neighbours.
+
+            \param energies
+                An array to store the corresponding pair energies.
+
+            \return
+                The number of interactions.
+        */
+        unsigned int computeInteractions(unsigned int, unsigned int[], double[]);
+
+        //! Divide the active particles into clusters of interacting particles.
+        /*! \param clusterIndex
+                The cluster index of each particle (nParticles for inactive particles).
+
+            \param members
+                The particles ordered by cluster.
+
+            \param clusterStart
+                Offset of the first member of each cluster (plus an end sentinel).
+
+            \param unwrapped
+                The particle positions, unwrapped across periodic boundaries within each cluster (flattened).
+
+            \param centres
+                The centre of mass of each cluster (flattened).
+
+            \return
+                Whether the clustering is valid, i.e. no cluster spans the periodic box.
+        */
+        bool computeClusters(std::vector<unsigned int>&, std::vector<unsigned int>&,
+            std::vector<unsigned int>&, std::vector<double>&, std::vector<double>&);
+
+        //! Compute the total non-pairwise energy of the clustered particles.
+        /*! \param members
+                The particles ordered by cluster.
+
+            \return
+                The non-pairwise energy.
+        */
+        double computeNonPairwiseEnergy(const std::vector<unsigned int>&);
+
+        //! Check whether any pair of particles in different clusters interact.
+        /*! \param clusterIndex
+                The cluster index of each particle.
+
+            \param unwrapped
+                The unwrapped particle positions prior to the move (flattened).
+
+            \return
+                Whether a new inter-cluster interaction exists.
+        */
+        bool isInterClusterInteraction(const std::vector<unsigned int>&, const std::vector<double>&);
 
         //! Compute particle's position and orientation following the trial move.
         /*! \param particle
@@ -406,32 +797,29 @@ namespace vmmc
         //! Apply/unnapply the virtual move.
         void swapMoveStatus();
 
-        //! Calculate an unbiased rotation vector in 3D (Beard & Schlick, BJ 85 2973 (2003)).
-        /*! \param v1
-                The vector about which to rotate (either the position or orientation).
-
-            \param v2
-                Rotation unit vector.
-
-            \param v3
-                The rotation vector.
+        //! Compute the rotation matrix for a trial rotation about the trial vector.
+        /*! In 3D the rotation is about the trial unit vector (Beard & Schlick, BJ 85 2973 (2003)),
+            in 2D it is a simple in plane rotation.
 
             \param angle
                 Trial rotation angle.
+
+            \param matrix
+                The rotation matrix (row major).
         */
-        void rotate3D(std::vector<double>&, std::vector<double>&, std::vector<double>&, double);
+        void computeRotationMatrix(double, std::vector<double>&);
 
-        //! Calculate a simple in plane rotatation vector.
-        /*! \param v1
+        //! Calculate the displacement of a vector under a precomputed rotation.
+        /*! \param matrix
+                The rotation matrix (row major).
+
+            \param v1
                 The vector to rotate (either the position or orientation).
 
             \param v2
-                The rotation vector.
-
-            \param angle
-                Trial rotation angle.
+                The rotation vector, i.e. the change in v1.
         */
-        void rotate2D(std::vector<double>&, std::vector<double>&, double);
+        void rotate(const std::vector<double>&, const std::vector<double>&, std::vector<double>&);
 
         //! Calculate the minimum image separation between two coordinates (from v1 to v2).
         /*! \param v1
@@ -459,6 +847,15 @@ namespace vmmc
                 The norm of the vector.
         */
         double computeNorm(std::vector<double>&);
+
+        //! Compute the Morton (Z-order) code of a position within the simulation box.
+        /*! \param vec
+                The coordinate vector.
+
+            \return
+                The Morton code.
+        */
+        unsigned long long computeMortonCode(const std::vector<double>&) const;
     };
 }
 